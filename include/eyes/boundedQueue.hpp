@@ -0,0 +1,112 @@
+#ifndef EYES_BOUNDED_QUEUE_HPP
+#define EYES_BOUNDED_QUEUE_HPP
+
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <stdint.h>
+
+enum queue_drop_policy
+{
+    DROP_NEWEST,    // keep what is queued, drop the item being pushed
+    DROP_OLDEST     // make room by dropping the oldest queued item
+};
+
+// Hands work from a hot loop to a background thread. push() never blocks,
+// when the queue is full an item is dropped and counted instead. Returns
+// false if the pushed item itself was dropped.
+template <typename T>
+class BoundedQueue
+{
+public:
+    explicit BoundedQueue(
+        size_t capacity,
+        enum queue_drop_policy policy = DROP_NEWEST)
+        : capacity(capacity), policy(policy), drops(0), closed(false) {}
+
+    bool push(const T &item)
+    {
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            if (closed) {
+                drops++;
+                return false;
+            } else if (items.size() >= capacity) {
+                drops++;
+                if (policy == DROP_NEWEST || capacity == 0) {
+                    return false;
+                }
+                items.pop_front();
+            }
+            items.push_back(item);
+        }
+        ready.notify_one();
+        return true;
+    }
+
+    // true when a push would drop the pushed item right now. With a single
+    // producer only a close() can make a push that follows a false return
+    // drop it, so the producer can skip preparing an item that would be
+    // thrown away and count it with drop() instead.
+    bool wouldDrop() const
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        return closed || (items.size() >= capacity
+            && (policy == DROP_NEWEST || capacity == 0));
+    }
+
+    void drop()
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        drops++;
+    }
+
+    // blocks until an item is available, returns false once the queue is
+    // closed and drained
+    bool pop(T &item)
+    {
+        std::unique_lock<std::mutex> guard(lock);
+        while (items.empty() && !closed) {
+            ready.wait(guard);
+        }
+        if (items.empty()) {
+            return false;
+        }
+
+        item = items.front();
+        items.pop_front();
+        return true;
+    }
+
+    void close()
+    {
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            closed = true;
+        }
+        ready.notify_all();
+    }
+
+    size_t size() const
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        return items.size();
+    }
+
+    uint64_t dropped() const
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        return drops;
+    }
+
+private:
+    mutable std::mutex lock;
+    std::condition_variable ready;
+    std::deque<T> items;
+    size_t capacity;
+    enum queue_drop_policy policy;
+    uint64_t drops;
+    bool closed;
+};
+
+#endif
@@ -0,0 +1,142 @@
+#ifndef EYES_CALIBRATION_BUNDLE_HPP
+#define EYES_CALIBRATION_BUNDLE_HPP
+
+#include <string>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <opencv2/core/core.hpp>
+
+// Binary calibration bundle
+//
+// File layout (native byte order, offsets are from the start of the file):
+//
+//   struct bundle_header              magic, version, image size, flags
+//   struct bundle_section[N]          section table
+//   section data                      each section aligned to BUNDLE_ALIGNMENT
+//
+// Matrices are stored densely (no row padding), so a loaded bundle hands out
+// cv::Mat headers that point straight into the memory mapped file. Nothing is
+// parsed or recomputed at startup, including the remap tables.
+#define BUNDLE_MAGIC "EYESCAL"
+#define BUNDLE_VERSION 1
+#define BUNDLE_ALIGNMENT 64
+#define BUNDLE_MAX_CAMERAS 2
+
+enum bundle_flags
+{
+    BUNDLE_HAS_INTRINSICS = 0x01,   // intrinsics and distortion per camera
+    BUNDLE_HAS_STEREO = 0x02,       // stereo extrinsics and rectification
+    BUNDLE_HAS_MAPS = 0x04          // precomputed remap tables
+};
+
+enum bundle_section_id
+{
+    SECTION_INTRINSICS = 0,         // per camera, 3x3 CV_64FC1
+    SECTION_DISTORTION,             // per camera, 5x1 CV_64FC1
+    SECTION_RECTIFICATION,          // per camera, 3x3 CV_64FC1
+    SECTION_PROJECTION,             // per camera, 3x4 CV_64FC1
+    SECTION_MAP_1,                  // per camera, CV_16SC2 remap table
+    SECTION_MAP_2,                  // per camera, CV_16UC1 remap table
+    SECTION_ROTATION,               // 3x3 CV_64FC1, camera 1 to camera 2
+    SECTION_TRANSLATION,            // 3x1 CV_64FC1, camera 1 to camera 2
+    SECTION_DISPARITY_TO_DEPTH,     // 4x4 CV_64FC1, Q matrix
+    SECTION_COUNT
+};
+
+struct bundle_header
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t flags;
+    int32_t image_width;
+    int32_t image_height;
+    uint32_t num_cameras;
+    uint32_t num_sections;
+};
+
+struct bundle_section
+{
+    uint32_t id;                    // bundle_section_id
+    uint32_t camera;                // camera index for per camera sections
+    int32_t type;                   // OpenCV matrix type
+    int32_t rows;
+    int32_t cols;
+    uint32_t reserved;
+    uint64_t offset;
+    uint64_t size;
+};
+
+struct camera_calibration
+{
+    cv::Mat intrinsics;
+    cv::Mat distortion;
+    cv::Mat rectification;
+    cv::Mat projection;
+    cv::Mat map_1;
+    cv::Mat map_2;
+};
+
+struct calibration_bundle
+{
+    uint32_t flags;
+    int num_cameras;
+    cv::Size image_size;
+    struct camera_calibration camera[BUNDLE_MAX_CAMERAS];
+
+    // stereo extrinsics
+    cv::Mat rotation;
+    cv::Mat translation;
+    cv::Mat disparity_to_depth;
+
+    // backing memory when the bundle was loaded from disk
+    void *mapping;
+    size_t mapping_size;
+};
+
+void initCalibrationBundle(struct calibration_bundle *bundle);
+
+// computes rectification (stereo only) and remap tables from the intrinsics,
+// distortion and, for stereo bundles, the extrinsics
+int computeRemapTables(struct calibration_bundle *bundle);
+
+int saveCalibrationBundle(
+    const std::string &path,
+    const struct calibration_bundle *bundle
+);
+
+// memory maps a bundle, matrices in the bundle reference the mapping and
+// remain valid until releaseCalibrationBundle() is called
+int loadCalibrationBundle(
+    const std::string &path,
+    struct calibration_bundle *bundle
+);
+
+void releaseCalibrationBundle(struct calibration_bundle *bundle);
+
+// XML interop, remap tables are not exported and are recomputed on import
+int exportCalibrationXML(
+    const std::string &path,
+    const struct calibration_bundle *bundle
+);
+int importCalibrationXML(
+    const std::string &path,
+    struct calibration_bundle *bundle
+);
+
+// imports .xml and .yml calibrations, memory maps anything else as a bundle
+int loadCalibration(
+    const std::string &path,
+    struct calibration_bundle *bundle
+);
+
+// remaps a frame of the calibrated size, fails without touching dst when
+// the bundle has no remap tables for the camera or the size differs
+int rectifyFrame(
+    const struct calibration_bundle *bundle,
+    int camera,
+    const cv::Mat &src,
+    cv::Mat &dst
+);
+
+#endif
@@ -0,0 +1,40 @@
+#ifndef EYES_DISPARITY_HPP
+#define EYES_DISPARITY_HPP
+
+#include <opencv2/core/core.hpp>
+#include <opencv2/calib3d/calib3d.hpp>
+
+// block matcher with the default stereoVision settings
+cv::StereoBM initDisparityCalculator();
+
+// 16-bit fixed point disparity map of a grayscale stereo pair
+cv::Mat calculateDisparity(cv::StereoBM bm, cv::Mat left, cv::Mat right);
+
+// recomputes the rows of an existing disparity map only, the pair is
+// matched on a band padded by the reach of the block matcher windows
+void calculateDisparityRows(
+    cv::StereoBM bm,
+    cv::Mat left,
+    cv::Mat right,
+    cv::Range rows,
+    cv::Mat &disparity_map
+);
+
+// Sparse disparity of a single object. Block matching only runs on a strip
+// around roi, widened on the left by the disparity search range, and the
+// median of the valid disparities inside roi is written to disparity (in
+// pixels). Returns the number of valid disparities, 0 when the object has
+// no texture to match or lies within the search range of the left border.
+int calculateRoiDisparity(
+    cv::StereoBM bm,
+    cv::Mat left,
+    cv::Mat right,
+    cv::Rect roi,
+    float &disparity
+);
+
+// reprojects a rectified left image point and its disparity to 3D with the
+// disparity to depth matrix Q of a stereo calibration
+cv::Point3f disparityToPoint(const cv::Mat &Q, cv::Point2f point, float disparity);
+
+#endif
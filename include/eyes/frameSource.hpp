@@ -0,0 +1,225 @@
+#ifndef EYES_FRAME_SOURCE_HPP
+#define EYES_FRAME_SOURCE_HPP
+
+#include <mutex>
+#include <memory>
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+#include <opencv2/core/core.hpp>
+#include <opencv2/highgui/highgui.hpp>
+
+// Pixel layout of Frame::image. Native camera formats are passed through
+// undecoded, see pixelFormat.hpp for the conversions out of them.
+enum frame_format
+{
+    FORMAT_BGR = 0,     // OpenCV native, CV_8UC3 (and any other OpenCV type)
+    FORMAT_GRAY,        // CV_8UC1
+    FORMAT_YUYV,        // packed 4:2:2 Y0 U Y1 V, CV_8UC2 of width x height
+    FORMAT_NV12         // Y plane followed by interleaved UV at half
+                        // resolution, CV_8UC1 of width x height * 3 / 2
+};
+
+// A frame handed out by a FrameSource. Copies of a Frame share the same
+// image buffer, the buffer goes back to the pool it came from once the last
+// copy is dropped. Keep the Frame (not just frame.image) alive for as long
+// as the pixels are needed.
+struct Frame
+{
+    cv::Mat image;
+    enum frame_format format;
+    int64_t timestamp;              // capture time in microseconds
+    uint64_t sequence;              // frame number since the source opened
+    std::shared_ptr<void> buffer;   // pool handle
+
+    Frame() : format(FORMAT_BGR), timestamp(0), sequence(0) {}
+    bool empty() const { return image.empty(); }
+
+    // size in pixels, which is not the image size for planar formats
+    cv::Size size() const
+    {
+        if (format == FORMAT_NV12) {
+            return cv::Size(image.cols, image.rows * 2 / 3);
+        }
+        return image.size();
+    }
+};
+
+// Recycles image buffers between frames so the capture loop does not
+// allocate a fresh Mat per frame. Buffers that are still referenced when
+// the pool runs dry are not waited on, a new buffer is allocated instead.
+class FramePool
+{
+public:
+    explicit FramePool(size_t capacity = 8);
+
+    Frame acquire(cv::Size size, int type);
+    size_t available() const;
+
+private:
+    struct State
+    {
+        std::mutex lock;
+        std::vector<cv::Mat> free;
+        size_t capacity;
+    };
+
+    std::shared_ptr<State> state;
+
+    static void recycle(std::weak_ptr<State> state, cv::Mat buffer);
+};
+
+class FrameSource
+{
+public:
+    virtual ~FrameSource() {}
+
+    virtual bool isOpened() const = 0;
+    virtual bool read(Frame &frame) = 0;
+    virtual cv::Size size() const = 0;
+    virtual std::string name() const = 0;
+
+protected:
+    FramePool pool;
+    uint64_t sequence;
+
+    FrameSource() : sequence(0) {}
+    Frame nextFrame(cv::Size size, int type);
+};
+
+// Cameras decode to BGR unless a native format is asked for. Native frames
+// are requested from the driver undecoded, if the capture backend ignores
+// the request the source falls back to BGR frames. Captures are created one
+// at a time across all sources, the capture backends keep global state while
+// they initialize a device, and only the negotiation after it overlaps.
+class CameraSource : public FrameSource
+{
+public:
+    CameraSource(
+        int index,
+        cv::Size size,
+        enum frame_format format = FORMAT_BGR
+    );
+
+    bool isOpened() const;
+    bool read(Frame &frame);
+    cv::Size size() const;
+    std::string name() const;
+
+private:
+    int index;
+    cv::VideoCapture capture;
+    enum frame_format format;
+    cv::Size frame_size;
+    cv::Size buffer_size;
+    int buffer_type;
+
+    bool unpackNative(Frame &frame);
+};
+
+class VideoFileSource : public FrameSource
+{
+public:
+    explicit VideoFileSource(const std::string &path);
+
+    bool isOpened() const;
+    bool read(Frame &frame);
+    cv::Size size() const;
+    std::string name() const;
+
+private:
+    std::string path;
+    cv::VideoCapture capture;
+    cv::Size frame_size;
+    int frame_type;
+};
+
+// Headerless file of back to back frames in a native format, e.g. the
+// output of ffmpeg -f rawvideo. Frames point straight into the mapped file.
+class RawVideoSource : public FrameSource
+{
+public:
+    RawVideoSource(
+        const std::string &path,
+        cv::Size size,
+        enum frame_format format
+    );
+
+    bool isOpened() const;
+    bool read(Frame &frame);
+    cv::Size size() const;
+    std::string name() const;
+
+private:
+    std::string path;
+    cv::Size frame_size;
+    enum frame_format format;
+    size_t frame_bytes;
+    size_t num_frames;
+    size_t index;
+    std::shared_ptr<char> mapping;
+};
+
+// printf style pattern with a single integer conversion, e.g.
+// "frames/left_%04d.png", any other pattern fails to open
+class ImageSequenceSource : public FrameSource
+{
+public:
+    ImageSequenceSource(const std::string &pattern, int start = 0);
+
+    bool isOpened() const;
+    bool read(Frame &frame);
+    cv::Size size() const;
+    std::string name() const;
+
+private:
+    std::string pattern;
+    bool valid;                 // pattern is safe to format with
+    int index;
+    cv::Size frame_size;
+
+    std::string imagePath(int i) const;
+};
+
+// Deterministic test scene: a coloured ball circling over a fixed random
+// texture. Sources with different shift values see the ball and texture
+// displaced horizontally, which makes a pair of them a stereo stand-in.
+class SyntheticSource : public FrameSource
+{
+public:
+    SyntheticSource(cv::Size size, int shift = 0);
+
+    bool isOpened() const;
+    bool read(Frame &frame);
+    cv::Size size() const;
+    std::string name() const;
+
+private:
+    cv::Size frame_size;
+    int shift;
+    cv::Mat background;
+};
+
+// Opens a source from a spec string:
+//
+//   camera:<index>[:<format>]        camera device (also a plain number),
+//                                    optionally in a native format
+//   file:<path>                      video file
+//   raw:<path>:<W>x<H>:<format>      raw video file in a native format
+//   images:<pattern>                 image sequence
+//   replay:<path>[:<stream>[:fast]]  recorded stream, at the original frame
+//                                    rate or as fast as it is read
+//   synthetic[:<W>x<H>[:<shift>]]    synthetic scene
+//
+// Specs without a prefix are treated as an image sequence when they contain
+// a '%' and as a video file otherwise. size is the requested capture size
+// for cameras and the default size for synthetic sources. Native formats are
+// bgr, gray, yuyv and nv12.
+cv::Ptr<FrameSource> openFrameSource(const std::string &spec, cv::Size size);
+
+// native format names as used in source specs, false for unknown names
+bool parseFrameFormat(const std::string &name, enum frame_format &format);
+const char *frameFormatName(enum frame_format format);
+
+#endif
@@ -0,0 +1,93 @@
+#ifndef EYES_HISTOGRAM_TRACKER_HPP
+#define EYES_HISTOGRAM_TRACKER_HPP
+
+#include <vector>
+
+#include <opencv2/core/core.hpp>
+
+// hue/saturation histogram resolution
+const int HISTOGRAM_H_BINS = 30;
+const int HISTOGRAM_S_BINS = 32;
+
+// pixels too grey or too dark to have a meaningful hue are ignored
+const int HISTOGRAM_MIN_SATURATION = 30;
+const int HISTOGRAM_MIN_VALUE = 10;
+
+const int CAMSHIFT_MAX_ITERATIONS = 10;
+const int CAMSHIFT_MIN_SIZE = 8;
+
+// object is lost below this back projected mass, in fully matching pixels
+const double CAMSHIFT_MIN_MASS = 20.0;
+
+// frames are searched for a lost object downscaled by this factor
+const int CAMSHIFT_REACQUIRE_SCALE = 4;
+
+// Colour tracking without hard thresholds. A hue/saturation histogram is
+// learned from the object once, and every frame is back projected through
+// it to the probability of each pixel belonging to the object. Mean shift
+// then moves the track window onto the centroid of that probability and
+// CamShift adapts its size and orientation.
+//
+// Only a search area around the last track window, three times its size,
+// is converted to HSV and back projected, and window sums come from
+// integral images of the back projection, so each mean shift iteration is
+// O(1) and the cost of a frame follows the size of the object rather than
+// the size of the frame. Once the object is lost, the whole frame is
+// downscaled and back projected, and the densest window of the last track
+// window's size becomes the next search area, so re-acquiring never
+// integrates more than a search area at full resolution either.
+class HistogramTracker
+{
+public:
+    HistogramTracker();
+
+    // learns the histogram from roi of a BGR frame and starts tracking there
+    void learn(const cv::Mat &frame, cv::Rect roi);
+
+    // follows the object into the next BGR frame, false when it is lost
+    bool track(const cv::Mat &frame);
+
+    bool isLearned() const;
+    bool isLost() const;
+
+    cv::RotatedRect box() const;
+    cv::Rect window() const;
+
+    // back projection of the search area of the last track() call, of the
+    // downscaled frame while the object is lost
+    cv::Rect searchArea() const;
+    const cv::Mat &backProjection() const;
+
+private:
+    // raw moments of the back projection over a window
+    struct window_moments
+    {
+        double m00;
+        double m10;
+        double m01;
+        double m20;
+        double m02;
+        double m11;
+    };
+
+    bool learned;
+    bool lost;
+    std::vector<uchar> lut;     // histogram bin to probability
+    int h_index[256];           // hue to the first bin of its row
+    int s_index[256];           // saturation to its bin in a row
+    cv::Rect track_window;
+    cv::RotatedRect track_box;
+    cv::Rect search;
+    cv::Mat hsv;
+    cv::Mat scaled;
+    cv::Mat density;            // back projected mass per window when lost
+    cv::Mat back_projection;
+    cv::Mat sums;               // integral images of p, xp, yp, xxp, yyp, xyp
+
+    uchar probability(const uchar *hsv_pixel) const;
+    bool reacquire(const cv::Mat &frame);
+    void backProject(const cv::Mat &frame);
+    struct window_moments moments(cv::Rect r) const;
+};
+
+#endif
@@ -0,0 +1,67 @@
+#ifndef EYES_MOTION_GATE_HPP
+#define EYES_MOTION_GATE_HPP
+
+#include <vector>
+
+#include <opencv2/core/core.hpp>
+
+// change detection runs on frames downscaled by this factor
+const int MOTION_SCALE = 4;
+const int MOTION_TILE_COLS = 16;
+const int MOTION_TILE_ROWS = 12;
+
+// grey level difference on the downscaled frame that counts as a change
+const int MOTION_THRESHOLD = 16;
+
+// Cheap change detection in front of the expensive stages. Each frame is
+// downscaled, converted to grey and compared against a reference on a grid
+// of tiles. The reference of a tile is only updated when the tile changes,
+// so it always holds what the cached results of that tile were computed
+// from, and slow drift still trips the gate eventually. Only brightness is
+// compared, a hue change at constant brightness does not trip the gate.
+class MotionGate
+{
+public:
+    explicit MotionGate(
+        cv::Size grid = cv::Size(MOTION_TILE_COLS, MOTION_TILE_ROWS),
+        int threshold = MOTION_THRESHOLD
+    );
+
+    // compares the frame against the reference and returns the number of
+    // changed tiles, every tile counts as changed on the first frame and
+    // whenever the frame size changes
+    int update(const cv::Mat &frame);
+
+    // reports every tile as changed on the next update, e.g. after the
+    // processing parameters changed and all cached results are stale
+    void invalidate();
+
+    cv::Size gridSize() const;
+    int numTiles() const;
+    int changedTiles() const;
+    bool tileChanged(int col, int row) const;
+    bool rowChanged(int row) const;
+
+    // tile area in frame coordinates
+    cv::Rect tileRect(int col, int row) const;
+
+    // changed areas in frame coordinates, each grown by margin pixels and
+    // merged with any other area it overlaps
+    std::vector<cv::Rect> changedRegions(int margin) const;
+
+private:
+    cv::Size grid;
+    int threshold;
+    bool valid;
+    int changed_tiles;
+    cv::Size frame_size;
+    cv::Mat reference;
+    cv::Mat scaled;
+    cv::Mat small;
+    cv::Mat diff;
+    cv::Mat tiles;
+
+    cv::Rect smallTileRect(int col, int row) const;
+};
+
+#endif
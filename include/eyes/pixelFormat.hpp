@@ -0,0 +1,54 @@
+#ifndef EYES_PIXEL_FORMAT_HPP
+#define EYES_PIXEL_FORMAT_HPP
+
+#include <opencv2/core/core.hpp>
+
+#include <eyes/frameSource.hpp>
+
+// Conversions out of the native capture formats
+//
+// Grey is the Y plane of the YUV formats, so stereo and calibration never
+// decode colour: NV12 grey is a zero-copy view of the Y plane, YUYV grey is
+// a single strided copy of every other byte. HSV is converted straight from
+// YUV in one pass, without an intermediate BGR image, and with the chroma
+// terms computed once per chroma sample instead of once per pixel. YUV is
+// BT.601 limited range, the same as V4L2 cameras deliver and OpenCV's
+// YUV to BGR conversions assume, so the results match cvtColor through BGR.
+//
+// The kernels are specialised per format, frameToGray() and friends
+// dispatch on Frame::format.
+template <enum frame_format F>
+void convertToGray(const cv::Mat &src, cv::Mat &gray);
+
+template <enum frame_format F>
+void convertToHSV(const cv::Mat &src, cv::Mat &hsv);
+
+template <enum frame_format F>
+void convertToBGR(const cv::Mat &src, cv::Mat &bgr);
+
+template <> void convertToGray<FORMAT_BGR>(const cv::Mat &src, cv::Mat &gray);
+template <> void convertToGray<FORMAT_GRAY>(const cv::Mat &src, cv::Mat &gray);
+template <> void convertToGray<FORMAT_YUYV>(const cv::Mat &src, cv::Mat &gray);
+template <> void convertToGray<FORMAT_NV12>(const cv::Mat &src, cv::Mat &gray);
+
+template <> void convertToHSV<FORMAT_BGR>(const cv::Mat &src, cv::Mat &hsv);
+template <> void convertToHSV<FORMAT_GRAY>(const cv::Mat &src, cv::Mat &hsv);
+template <> void convertToHSV<FORMAT_YUYV>(const cv::Mat &src, cv::Mat &hsv);
+template <> void convertToHSV<FORMAT_NV12>(const cv::Mat &src, cv::Mat &hsv);
+
+template <> void convertToBGR<FORMAT_BGR>(const cv::Mat &src, cv::Mat &bgr);
+template <> void convertToBGR<FORMAT_GRAY>(const cv::Mat &src, cv::Mat &bgr);
+template <> void convertToBGR<FORMAT_YUYV>(const cv::Mat &src, cv::Mat &bgr);
+template <> void convertToBGR<FORMAT_NV12>(const cv::Mat &src, cv::Mat &bgr);
+
+// The results may share the frame's buffer (grey of NV12 and grey frames,
+// BGR of BGR frames), keep the frame alive for as long as they are used and
+// do not draw on them unless the frame is yours to draw on.
+void frameToGray(const Frame &frame, cv::Mat &gray);
+void frameToHSV(const Frame &frame, cv::Mat &hsv);
+void frameToBGR(const Frame &frame, cv::Mat &bgr);
+
+// packs a BGR image into a native format, for synthetic input
+void convertFromBGR(const cv::Mat &bgr, enum frame_format format, cv::Mat &dst);
+
+#endif
@@ -0,0 +1,184 @@
+#ifndef EYES_RECORDING_HPP
+#define EYES_RECORDING_HPP
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include <opencv2/core/core.hpp>
+
+#include <eyes/boundedQueue.hpp>
+#include <eyes/frameSource.hpp>
+
+// Raw frame recording
+//
+// File layout (native byte order, offsets are from the start of the file):
+//
+//   struct recording_header        magic, version, stream count and the
+//                                  offset of the last complete chunk
+//   frame data                     raw pixels, each frame aligned to
+//                                  RECORDING_ALIGNMENT
+//   struct recording_chunk         written after every RECORDING_CHUNK_FRAMES
+//   struct recording_entry[N]      frames, indexes the frames of the chunk
+//   ...
+//
+// Chunks link back to the previous chunk and the header is updated after
+// each chunk, so a recording cut short by a crash is readable up to its
+// last complete chunk. Frames are stored densely, in the format they were
+// captured in, so a memory mapped recording replays without copying or
+// decoding.
+#define RECORDING_MAGIC "EYESREC"
+#define CHUNK_MAGIC "EYESCHK"
+#define RECORDING_VERSION 1
+#define RECORDING_ALIGNMENT 64
+#define RECORDING_CHUNK_FRAMES 32
+#define RECORDING_MAX_STREAMS 8
+
+struct recording_header
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t num_streams;
+    uint64_t last_chunk;            // offset of the last complete chunk
+    uint64_t num_frames;
+};
+
+struct recording_chunk
+{
+    char magic[8];
+    uint32_t num_entries;
+    uint32_t reserved;
+    uint64_t previous_chunk;        // 0 for the first chunk
+};
+
+struct recording_entry
+{
+    uint64_t offset;
+    uint64_t size;
+    int64_t timestamp;              // capture time in microseconds
+    uint64_t record;                // frames of one stereo pair share this
+    uint32_t stream;
+    int32_t type;                   // OpenCV matrix type
+    int32_t rows;
+    int32_t cols;
+    uint32_t format;                // enum frame_format, 0 for OpenCV native
+    uint32_t reserved;
+};
+
+// Records raw frames from the capture loop. record() copies the pixels into
+// a pooled buffer and queues them for a background writer thread, it never
+// waits on the disk. When the writer falls behind frames are dropped, and
+// frames of one record are always dropped together, before they are copied.
+// record() is meant to be called from one thread. A write error stops the
+// recording, later records are dropped and close() reports it.
+class FrameRecorder
+{
+public:
+    FrameRecorder(
+        const std::string &path,
+        int num_streams,
+        size_t queue_capacity = 16
+    );
+    ~FrameRecorder();
+
+    bool isOpened() const;
+    bool record(const Frame &frame);
+    bool record(const Frame &left, const Frame &right);
+    bool record(const std::vector<Frame> &frames);
+
+    // finishes the recording, -1 when it could not be written in full
+    int close();
+
+    bool hasFailed() const;
+    uint64_t dropped() const;
+
+private:
+    struct item
+    {
+        uint64_t record;
+        std::vector<Frame> frames;
+    };
+
+    std::string path;
+    FILE *fp;
+    std::atomic<bool> failed;
+    struct recording_header header;
+    std::vector<struct recording_entry> chunk;
+    uint64_t records;
+    FramePool pool;
+    BoundedQueue<struct item> queue;
+    std::thread writer;
+
+    void fail();
+    void writeFrames();
+    int writeFrame(uint64_t record, uint32_t stream, const Frame &frame);
+    int writeChunk();
+
+    FrameRecorder(const FrameRecorder &);
+    FrameRecorder &operator=(const FrameRecorder &);
+};
+
+// Records every frame read through it
+class RecordingSource : public FrameSource
+{
+public:
+    RecordingSource(cv::Ptr<FrameSource> source, const std::string &path);
+
+    bool isOpened() const;
+    bool read(Frame &frame);
+    cv::Size size() const;
+    std::string name() const;
+
+private:
+    cv::Ptr<FrameSource> source;
+    std::shared_ptr<FrameRecorder> recorder;
+};
+
+// Memory mapped recording with the frame index of every stream
+class RecordingFile
+{
+public:
+    ~RecordingFile();
+
+    static std::shared_ptr<RecordingFile> open(const std::string &path);
+
+    int numStreams() const;
+    const std::vector<struct recording_entry> &stream(int index) const;
+    cv::Mat image(const struct recording_entry &entry) const;
+
+private:
+    char *mapping;
+    size_t mapping_size;
+    int num_streams;
+    std::vector<std::vector<struct recording_entry> > streams;
+
+    RecordingFile();
+};
+
+// Replays one stream of a recording, either at the original frame rate or
+// as fast as the consumer reads. Frames point straight into the mapping.
+class ReplaySource : public FrameSource
+{
+public:
+    ReplaySource(const std::string &path, int stream, bool realtime);
+
+    bool isOpened() const;
+    bool read(Frame &frame);
+    cv::Size size() const;
+    std::string name() const;
+
+private:
+    std::string path;
+    int stream_index;
+    bool realtime;
+    size_t index;
+    int64_t start;
+    std::shared_ptr<RecordingFile> file;
+};
+
+#endif
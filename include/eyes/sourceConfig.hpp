@@ -0,0 +1,69 @@
+#ifndef EYES_SOURCE_CONFIG_HPP
+#define EYES_SOURCE_CONFIG_HPP
+
+#include <string>
+#include <vector>
+
+#include <opencv2/core/core.hpp>
+
+#include <eyes/frameSource.hpp>
+
+// discovered sources are cached here, in the same format as --config files
+#define SOURCE_CACHE "sources.yml"
+
+// discovery opens the stereo pair only, a configuration may list more
+const size_t DISCOVERED_SOURCES = 2;
+
+struct video_device
+{
+    int index;                      // camera index, N of /dev/videoN
+    std::string path;
+    std::string name;               // driver reported card name
+};
+
+// Sources of a multi camera program, stored with cv::FileStorage:
+//
+//   %YAML:1.0
+//   sources: [ "camera:0:yuyv", "camera:1:yuyv" ]
+//   devices: [ "/dev/video0 HD Webcam", "/dev/video2 HD Webcam" ]
+//   width: 640
+//   height: 480
+//
+// devices names the devices the sources were discovered as and is left out
+// of hand written configurations. Any source spec works, so a configuration
+// of file, replay or synthetic specs stands in for cameras.
+struct source_config
+{
+    std::vector<std::string> specs;
+    std::vector<std::string> devices;
+    cv::Size size;
+};
+
+// Lists capture devices from /dev and sysfs without opening them. Only the
+// first node of each device is listed, the others carry metadata.
+std::vector<struct video_device> enumerateVideoDevices();
+
+int loadSourceConfig(const std::string &path, struct source_config *config);
+int saveSourceConfig(const std::string &path, const struct source_config *config);
+
+// Discovers camera sources. The cached configuration is used while the
+// devices it was discovered from are still the ones plugged in, otherwise
+// the first max_sources enumerated devices become camera sources of the
+// given size.
+int discoverSources(
+    const std::string &cache_path,
+    cv::Size size,
+    struct source_config *config,
+    size_t max_sources = DISCOVERED_SOURCES
+);
+
+// Opens all sources concurrently, so startup takes as long as the slowest
+// device instead of the sum of all of them. Only creating the captures is
+// serialized (see CameraSource). Sources that failed to open are left empty
+// and named in the log.
+std::vector<cv::Ptr<FrameSource> > openFrameSources(
+    const std::vector<std::string> &specs,
+    cv::Size size
+);
+
+#endif
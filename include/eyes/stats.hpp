@@ -0,0 +1,100 @@
+#ifndef EYES_STATS_HPP
+#define EYES_STATS_HPP
+
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <stdint.h>
+
+// Per stage latency instrumentation
+//
+// Every thread records into its own histograms, so recording is a couple of
+// relaxed atomic stores and never takes a lock. The exporter thread merges
+// the per thread histograms when it dumps. A thread's histograms are merged
+// into a shared set and freed when the thread exits. While stats are
+// disabled a timer costs one branch on a global flag.
+//
+//   void morphOps(cv::Mat &thresh)
+//   {
+//       STATS_SCOPE("morphology");
+//       ...
+//   }
+#define STATS_MAX_STAGES 32
+#define STATS_MAX_COUNTERS 16
+#define STATS_MAX_GAUGES 16
+#define STATS_BUCKETS 256
+
+#define STATS_CONCAT_(a, b) a##b
+#define STATS_CONCAT(a, b) STATS_CONCAT_(a, b)
+
+#define STATS_SCOPE(name) \
+    static const int STATS_CONCAT(stats_stage_, __LINE__) = \
+        statsRegisterStage(name); \
+    ScopedTimer STATS_CONCAT(stats_timer_, __LINE__)( \
+        STATS_CONCAT(stats_stage_, __LINE__) \
+    )
+
+#define STATS_COUNT(name, n) \
+    do { \
+        if (stats_enabled.load(std::memory_order_relaxed)) { \
+            static const int stats_counter = statsRegisterCounter(name); \
+            statsCount(stats_counter, n); \
+        } \
+    } while (0)
+
+#define STATS_GAUGE(name, value) \
+    do { \
+        if (stats_enabled.load(std::memory_order_relaxed)) { \
+            static const int stats_gauge = statsRegisterGauge(name); \
+            statsGauge(stats_gauge, value); \
+        } \
+    } while (0)
+
+extern std::atomic<bool> stats_enabled;
+
+int statsRegisterStage(const char *name);
+int statsRegisterCounter(const char *name);
+int statsRegisterGauge(const char *name);
+void statsRecord(int stage, uint64_t nanoseconds);
+void statsCount(int counter, uint64_t n);
+void statsGauge(int gauge, int64_t value);
+
+// starts the exporter, the output format follows the file extension,
+// ".prom" writes Prometheus text format and anything else writes JSON
+int statsStart(const std::string &path, double interval_seconds = 1.0);
+void statsStop();
+int statsDump(const std::string &path);
+
+class ScopedTimer
+{
+public:
+    explicit ScopedTimer(int stage)
+        : stage(stage), active(stats_enabled.load(std::memory_order_relaxed))
+    {
+        if (active) {
+            start = std::chrono::steady_clock::now();
+        }
+    }
+
+    ~ScopedTimer()
+    {
+        if (active) {
+            statsRecord(
+                stage,
+                std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    std::chrono::steady_clock::now() - start
+                ).count()
+            );
+        }
+    }
+
+private:
+    int stage;
+    bool active;
+    std::chrono::steady_clock::time_point start;
+
+    ScopedTimer(const ScopedTimer &);
+    ScopedTimer &operator=(const ScopedTimer &);
+};
+
+#endif
@@ -0,0 +1,100 @@
+#ifndef EYES_TRACKING_HPP
+#define EYES_TRACKING_HPP
+
+#include <string>
+#include <vector>
+
+#include <opencv2/core/core.hpp>
+
+// object filter limits, tuned at a 400x300 capture
+const int TRACKING_WIDTH = 400;
+const int TRACKING_HEIGHT = 300;
+const int MAX_NUM_OBJECTS = 50;
+const int MIN_OBJECT_AREA = 20 * 20;
+const int MAX_OBJECT_AREA = TRACKING_HEIGHT * TRACKING_WIDTH / 1.5;
+
+// how far morphOps reaches beyond a changed pixel
+const int MORPH_REACH = 10;
+
+// trackFilteredObject results
+const int TRACKING_NOISE = -1;
+const int TRACKING_NONE = 0;
+const int TRACKING_FOUND = 1;
+
+// detection levels of the pyramid mode are kept at most this wide
+const int PYRAMID_MAX_WIDTH = 640;
+
+// object area limits scaled to a resolution
+struct tracking_limits
+{
+    double min_area;
+    double max_area;
+};
+
+struct tracked_object
+{
+    cv::Point2f centre;         // full resolution centroid
+    cv::Rect bounds;            // full resolution bounding box
+    double area;                // full resolution area in pixels
+};
+
+std::string intToString(int number);
+
+struct tracking_limits trackingLimits(cv::Size resolution);
+
+// number of halvings needed to bring a frame down to PYRAMID_MAX_WIDTH
+int pyramidLevels(cv::Size resolution);
+
+// draws crosshairs and the co-ordinates of a tracked object
+void drawObject(int x, int y, cv::Mat &frame);
+
+// erodes noise out of and dilates objects in a thresholded image
+void morphOps(cv::Mat &thresh);
+
+// draws a trackFilteredObject result, so a cached result can be drawn
+// again without tracking, an empty cameraFeed is left alone
+void drawTrackingStatus(int status, int x, int y, cv::Mat &cameraFeed);
+
+// finds the filtered object in a thresholded image, x and y are set to the
+// object's centroid and the result is drawn onto cameraFeed. Returns one of
+// TRACKING_FOUND, TRACKING_NONE or TRACKING_NOISE.
+int trackFilteredObject(int &x, int &y, cv::Mat threshold, cv::Mat &cameraFeed);
+
+// Finds every filtered object in a thresholded image that passes the area
+// limits of trackFilteredObject, with its full bounding box. Returns the
+// number of objects found or -1 if there are too many blobs to be anything
+// but noise.
+int findFilteredObjects(
+    const cv::Mat &threshold,
+    std::vector<struct tracked_object> &objects
+);
+
+// Recomputes the HSV conversion and threshold (and morphOps when use_morph
+// is set) of frame inside regions only, leaving the rest of hsv and
+// threshold as they were. Both are reallocated, and recomputed in full, when
+// they do not match the frame size.
+void thresholdRegions(
+    const cv::Mat &frame,
+    const std::vector<cv::Rect> &regions,
+    cv::Scalar hsv_min,
+    cv::Scalar hsv_max,
+    bool use_morph,
+    cv::Mat &hsv,
+    cv::Mat &threshold
+);
+
+// Detects candidate objects on a downscaled level of the frame, then refines
+// each centroid in a small full resolution patch around it. Returns the
+// number of objects found, or -1 if there were too many candidates to be
+// anything but noise. The threshold of the detection level is written to
+// level_threshold when given.
+int trackPyramid(
+    const cv::Mat &frame,
+    cv::Scalar hsv_min,
+    cv::Scalar hsv_max,
+    bool use_morph,
+    std::vector<struct tracked_object> &objects,
+    cv::Mat *level_threshold = NULL
+);
+
+#endif
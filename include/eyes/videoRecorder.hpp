@@ -0,0 +1,61 @@
+#ifndef EYES_VIDEO_RECORDER_HPP
+#define EYES_VIDEO_RECORDER_HPP
+
+#include <atomic>
+#include <string>
+#include <thread>
+#include <stdint.h>
+
+#include <opencv2/core/core.hpp>
+#include <opencv2/highgui/highgui.hpp>
+
+#include <eyes/boundedQueue.hpp>
+#include <eyes/frameSource.hpp>
+
+// Encodes program output (annotated frames, disparity maps) to a video file
+// on a background thread, so encoding latency never reaches the processing
+// loop. write() only queues a reference to the frame: the caller must not
+// draw on it afterwards. Frames that are not 8-bit are scaled to 8-bit by
+// the encoder thread. The writer is opened on the first frame, with the
+// size and channel count of that frame.
+class VideoRecorder
+{
+public:
+    VideoRecorder(
+        const std::string &name,
+        const std::string &path,
+        double fps,
+        enum queue_drop_policy policy = DROP_OLDEST,
+        size_t queue_capacity = 8
+    );
+    ~VideoRecorder();
+
+    bool write(const Frame &frame);
+    bool write(const cv::Mat &image);
+    void close();
+
+    size_t queueDepth() const;
+    uint64_t dropped() const;
+    uint64_t written() const;
+
+private:
+    std::string name;
+    std::string path;
+    double fps;
+    cv::VideoWriter writer;
+    BoundedQueue<Frame> queue;
+    std::atomic<uint64_t> frames_written;
+    std::thread encoder;
+    bool running;
+    int queue_gauge;
+    int drop_counter;
+
+    void encodeFrames();
+
+    VideoRecorder(const VideoRecorder &);
+    VideoRecorder &operator=(const VideoRecorder &);
+};
+
+enum queue_drop_policy parseDropPolicy(const std::string &policy);
+
+#endif
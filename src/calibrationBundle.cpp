@@ -0,0 +1,497 @@
+#include <stdio.h>
+#include <sstream>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <opencv2/core/core.hpp>
+#include <opencv2/imgproc/imgproc.hpp>
+#include <opencv2/calib3d/calib3d.hpp>
+
+#include <dbg/dbg.h>
+
+#include <eyes/calibrationBundle.hpp>
+
+static const char *section_names[SECTION_COUNT] = {
+    "intrinsics",
+    "distortion",
+    "rectification",
+    "projection",
+    "map_1",
+    "map_2",
+    "rotation",
+    "translation",
+    "disparity_to_depth"
+};
+
+static const cv::Mat *bundleSection(
+    const struct calibration_bundle *bundle,
+    uint32_t id,
+    uint32_t camera)
+{
+    if (camera >= BUNDLE_MAX_CAMERAS) {
+        return NULL;
+    }
+
+    switch (id) {
+    case SECTION_INTRINSICS: return &bundle->camera[camera].intrinsics;
+    case SECTION_DISTORTION: return &bundle->camera[camera].distortion;
+    case SECTION_RECTIFICATION: return &bundle->camera[camera].rectification;
+    case SECTION_PROJECTION: return &bundle->camera[camera].projection;
+    case SECTION_MAP_1: return &bundle->camera[camera].map_1;
+    case SECTION_MAP_2: return &bundle->camera[camera].map_2;
+    case SECTION_ROTATION: return &bundle->rotation;
+    case SECTION_TRANSLATION: return &bundle->translation;
+    case SECTION_DISPARITY_TO_DEPTH: return &bundle->disparity_to_depth;
+    }
+
+    return NULL;
+}
+
+static cv::Mat *bundleSection(
+    struct calibration_bundle *bundle,
+    uint32_t id,
+    uint32_t camera)
+{
+    const struct calibration_bundle *b = bundle;
+    return const_cast<cv::Mat *>(bundleSection(b, id, camera));
+}
+
+static bool isPerCameraSection(uint32_t id)
+{
+    return id <= SECTION_MAP_2;
+}
+
+static uint64_t alignOffset(uint64_t offset)
+{
+    return (offset + BUNDLE_ALIGNMENT - 1) & ~((uint64_t) BUNDLE_ALIGNMENT - 1);
+}
+
+void initCalibrationBundle(struct calibration_bundle *bundle)
+{
+    bundle->flags = 0;
+    bundle->num_cameras = 0;
+    bundle->image_size = cv::Size(0, 0);
+    for (int i = 0; i < BUNDLE_MAX_CAMERAS; i++) {
+        bundle->camera[i] = camera_calibration();
+    }
+    bundle->rotation.release();
+    bundle->translation.release();
+    bundle->disparity_to_depth.release();
+    bundle->mapping = NULL;
+    bundle->mapping_size = 0;
+}
+
+int computeRemapTables(struct calibration_bundle *bundle)
+{
+    struct camera_calibration *cam_1 = &bundle->camera[0];
+    struct camera_calibration *cam_2 = &bundle->camera[1];
+
+    if ((bundle->flags & BUNDLE_HAS_INTRINSICS) == 0) {
+        log_err("Bundle has no intrinsics to compute remap tables from!");
+        return -1;
+    }
+
+    // rectify stereo pair
+    if (bundle->flags & BUNDLE_HAS_STEREO) {
+        if (bundle->num_cameras != 2) {
+            log_err("Stereo bundle requires 2 cameras!");
+            return -1;
+        }
+
+        if (cam_1->rectification.empty() || cam_2->rectification.empty()) {
+            cv::stereoRectify(
+                cam_1->intrinsics,
+                cam_1->distortion,
+                cam_2->intrinsics,
+                cam_2->distortion,
+                bundle->image_size,
+                bundle->rotation,
+                bundle->translation,
+                cam_1->rectification,
+                cam_2->rectification,
+                cam_1->projection,
+                cam_2->projection,
+                bundle->disparity_to_depth,
+                cv::CALIB_ZERO_DISPARITY,
+                0
+            );
+        }
+    }
+
+    // build fixed point remap tables, these are considerably faster to
+    // remap with than floating point ones
+    for (int i = 0; i < bundle->num_cameras; i++) {
+        struct camera_calibration *cam = &bundle->camera[i];
+        cv::Mat map_1;
+        cv::Mat map_2;
+
+        if (bundle->flags & BUNDLE_HAS_STEREO) {
+            cv::initUndistortRectifyMap(
+                cam->intrinsics,
+                cam->distortion,
+                cam->rectification,
+                cam->projection,
+                bundle->image_size,
+                CV_16SC2,
+                map_1,
+                map_2
+            );
+        } else {
+            cv::initUndistortRectifyMap(
+                cam->intrinsics,
+                cam->distortion,
+                cv::Mat(),
+                cam->intrinsics,
+                bundle->image_size,
+                CV_16SC2,
+                map_1,
+                map_2
+            );
+        }
+
+        cam->map_1 = map_1;
+        cam->map_2 = map_2;
+    }
+    bundle->flags |= BUNDLE_HAS_MAPS;
+
+    return 0;
+}
+
+int saveCalibrationBundle(
+    const std::string &path,
+    const struct calibration_bundle *bundle)
+{
+    struct bundle_header header;
+    std::vector<struct bundle_section> sections;
+    std::vector<cv::Mat> data;
+    uint64_t offset = 0;
+    FILE *fp = NULL;
+
+    // collect non-empty sections
+    for (uint32_t id = 0; id < SECTION_COUNT; id++) {
+        int cameras = isPerCameraSection(id) ? bundle->num_cameras : 1;
+
+        for (int c = 0; c < cameras; c++) {
+            const cv::Mat *mat = bundleSection(bundle, id, c);
+            if (mat == NULL || mat->empty()) {
+                continue;
+            }
+
+            struct bundle_section section;
+            memset(&section, 0, sizeof(section));
+            section.id = id;
+            section.camera = c;
+            section.type = mat->type();
+            section.rows = mat->rows;
+            section.cols = mat->cols;
+            section.size = (uint64_t) mat->total() * mat->elemSize();
+
+            sections.push_back(section);
+            data.push_back(mat->isContinuous() ? *mat : mat->clone());
+        }
+    }
+
+    // header
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, BUNDLE_MAGIC, sizeof(BUNDLE_MAGIC));
+    header.version = BUNDLE_VERSION;
+    header.flags = bundle->flags;
+    header.image_width = bundle->image_size.width;
+    header.image_height = bundle->image_size.height;
+    header.num_cameras = bundle->num_cameras;
+    header.num_sections = sections.size();
+
+    // layout section data
+    offset = sizeof(header) + sections.size() * sizeof(struct bundle_section);
+    for (size_t i = 0; i < sections.size(); i++) {
+        offset = alignOffset(offset);
+        sections[i].offset = offset;
+        offset += sections[i].size;
+    }
+
+    // write
+    fp = fopen(path.c_str(), "wb");
+    if (fp == NULL) {
+        log_err("Failed to open [%s] for writing!", path.c_str());
+        return -1;
+    }
+
+    fwrite(&header, sizeof(header), 1, fp);
+    if (sections.size()) {
+        fwrite(&sections[0], sizeof(struct bundle_section), sections.size(), fp);
+    }
+
+    for (size_t i = 0; i < sections.size(); i++) {
+        static const char padding[BUNDLE_ALIGNMENT] = {0};
+        long pos = ftell(fp);
+
+        fwrite(padding, 1, sections[i].offset - pos, fp);
+        fwrite(data[i].data, 1, sections[i].size, fp);
+    }
+
+    if (ferror(fp)) {
+        log_err("Failed to write calibration bundle [%s]!", path.c_str());
+        fclose(fp);
+        return -1;
+    }
+    fclose(fp);
+
+    return 0;
+}
+
+int loadCalibrationBundle(
+    const std::string &path,
+    struct calibration_bundle *bundle)
+{
+    struct stat st;
+    struct bundle_header *header;
+    struct bundle_section *sections;
+    char *mapping;
+    int fd;
+
+    initCalibrationBundle(bundle);
+
+    // map file
+    fd = open(path.c_str(), O_RDONLY);
+    if (fd == -1) {
+        log_err("Failed to open calibration bundle [%s]!", path.c_str());
+        return -1;
+    }
+
+    if (fstat(fd, &st) == -1 || (size_t) st.st_size < sizeof(*header)) {
+        log_err("Invalid calibration bundle [%s]!", path.c_str());
+        close(fd);
+        return -1;
+    }
+
+    // private writable mapping, pages are only copied if a caller writes
+    // into one of the matrices
+    mapping = (char *) mmap(
+        NULL,
+        st.st_size,
+        PROT_READ | PROT_WRITE,
+        MAP_PRIVATE,
+        fd,
+        0
+    );
+    close(fd);
+    if (mapping == MAP_FAILED) {
+        log_err("Failed to mmap calibration bundle [%s]!", path.c_str());
+        return -1;
+    }
+    bundle->mapping = mapping;
+    bundle->mapping_size = st.st_size;
+
+    // check header
+    header = (struct bundle_header *) mapping;
+    if (memcmp(header->magic, BUNDLE_MAGIC, sizeof(BUNDLE_MAGIC)) != 0) {
+        log_err("[%s] is not a calibration bundle!", path.c_str());
+        goto error;
+    } else if (header->version != BUNDLE_VERSION) {
+        log_err(
+            "Unsupported calibration bundle version %u!",
+            header->version
+        );
+        goto error;
+    } else if (header->image_width < 0 || header->image_height < 0) {
+        log_err("Calibration bundle has an invalid image size!");
+        goto error;
+    } else if (header->num_cameras > BUNDLE_MAX_CAMERAS) {
+        log_err("Calibration bundle has too many cameras!");
+        goto error;
+    } else if (sizeof(*header) + header->num_sections * sizeof(*sections)
+            > bundle->mapping_size) {
+        log_err("Calibration bundle section table is truncated!");
+        goto error;
+    }
+
+    bundle->flags = header->flags;
+    bundle->num_cameras = header->num_cameras;
+    bundle->image_size = cv::Size(header->image_width, header->image_height);
+
+    // point matrices into the mapping
+    sections = (struct bundle_section *) (mapping + sizeof(*header));
+    for (uint32_t i = 0; i < header->num_sections; i++) {
+        struct bundle_section *s = &sections[i];
+        cv::Mat *mat = bundleSection(bundle, s->id, s->camera);
+        uint64_t expected;
+
+        if (mat == NULL) {
+            log_warn("Skipping unknown bundle section %u", s->id);
+            continue;
+        }
+
+        // bound every term before multiplying or adding, a corrupt table
+        // must not wrap around into a valid looking section
+        if (s->rows < 0 || s->cols < 0
+                || s->type != CV_MAT_TYPE(s->type)
+                || (uint64_t) s->rows * s->cols > bundle->mapping_size
+                || s->offset > bundle->mapping_size
+                || s->size > bundle->mapping_size - s->offset
+                || s->offset % BUNDLE_ALIGNMENT != 0) {
+            log_err("Corrupt bundle section [%s]!", section_names[s->id]);
+            goto error;
+        }
+        expected = (uint64_t) s->rows * s->cols * CV_ELEM_SIZE(s->type);
+        if (s->size != expected) {
+            log_err("Corrupt bundle section [%s]!", section_names[s->id]);
+            goto error;
+        }
+
+        *mat = cv::Mat(s->rows, s->cols, s->type, mapping + s->offset);
+    }
+
+    return 0;
+error:
+    releaseCalibrationBundle(bundle);
+    return -1;
+}
+
+void releaseCalibrationBundle(struct calibration_bundle *bundle)
+{
+    void *mapping = bundle->mapping;
+    size_t mapping_size = bundle->mapping_size;
+
+    // drop matrix headers before unmapping the memory they point to
+    initCalibrationBundle(bundle);
+    if (mapping) {
+        munmap(mapping, mapping_size);
+    }
+}
+
+int exportCalibrationXML(
+    const std::string &path,
+    const struct calibration_bundle *bundle)
+{
+    cv::FileStorage fs(path, cv::FileStorage::WRITE);
+    if (!fs.isOpened()) {
+        log_err("Failed to open [%s] for writing!", path.c_str());
+        return -1;
+    }
+
+    fs << "image_width" << bundle->image_size.width;
+    fs << "image_height" << bundle->image_size.height;
+    fs << "num_cameras" << bundle->num_cameras;
+    fs << "stereo" << ((bundle->flags & BUNDLE_HAS_STEREO) ? 1 : 0);
+
+    for (int i = 0; i < bundle->num_cameras; i++) {
+        const struct camera_calibration *cam = &bundle->camera[i];
+        std::stringstream prefix;
+        prefix << "camera_" << i << "_";
+
+        fs << prefix.str() + "intrinsics" << cam->intrinsics;
+        fs << prefix.str() + "distortion" << cam->distortion;
+        if (bundle->flags & BUNDLE_HAS_STEREO) {
+            fs << prefix.str() + "rectification" << cam->rectification;
+            fs << prefix.str() + "projection" << cam->projection;
+        }
+    }
+
+    if (bundle->flags & BUNDLE_HAS_STEREO) {
+        fs << "rotation" << bundle->rotation;
+        fs << "translation" << bundle->translation;
+        fs << "disparity_to_depth" << bundle->disparity_to_depth;
+    }
+
+    return 0;
+}
+
+int importCalibrationXML(
+    const std::string &path,
+    struct calibration_bundle *bundle)
+{
+    int stereo = 0;
+    cv::FileStorage fs(path, cv::FileStorage::READ);
+
+    initCalibrationBundle(bundle);
+    if (!fs.isOpened()) {
+        log_err("Failed to open calibration file [%s]!", path.c_str());
+        return -1;
+    }
+
+    fs["image_width"] >> bundle->image_size.width;
+    fs["image_height"] >> bundle->image_size.height;
+    fs["num_cameras"] >> bundle->num_cameras;
+    fs["stereo"] >> stereo;
+
+    if (bundle->num_cameras < 1 || bundle->num_cameras > BUNDLE_MAX_CAMERAS) {
+        log_err("Invalid number of cameras in [%s]!", path.c_str());
+        return -1;
+    }
+
+    for (int i = 0; i < bundle->num_cameras; i++) {
+        struct camera_calibration *cam = &bundle->camera[i];
+        std::stringstream prefix;
+        prefix << "camera_" << i << "_";
+
+        fs[prefix.str() + "intrinsics"] >> cam->intrinsics;
+        fs[prefix.str() + "distortion"] >> cam->distortion;
+        fs[prefix.str() + "rectification"] >> cam->rectification;
+        fs[prefix.str() + "projection"] >> cam->projection;
+    }
+    bundle->flags |= BUNDLE_HAS_INTRINSICS;
+
+    if (stereo) {
+        fs["rotation"] >> bundle->rotation;
+        fs["translation"] >> bundle->translation;
+        fs["disparity_to_depth"] >> bundle->disparity_to_depth;
+        bundle->flags |= BUNDLE_HAS_STEREO;
+    }
+
+    return computeRemapTables(bundle);
+}
+
+static bool endsWith(const std::string &s, const char *suffix)
+{
+    size_t n = strlen(suffix);
+
+    return s.size() >= n && s.compare(s.size() - n, n, suffix) == 0;
+}
+
+int loadCalibration(
+    const std::string &path,
+    struct calibration_bundle *bundle)
+{
+    if (endsWith(path, ".xml") || endsWith(path, ".yml")) {
+        return importCalibrationXML(path, bundle);
+    }
+
+    return loadCalibrationBundle(path, bundle);
+}
+
+int rectifyFrame(
+    const struct calibration_bundle *bundle,
+    int camera,
+    const cv::Mat &src,
+    cv::Mat &dst)
+{
+    const struct camera_calibration *cam;
+
+    // matching unrectified frames gives plausible but wrong disparities, so
+    // never hand the input back as if it had been rectified
+    if (camera < 0 || camera >= bundle->num_cameras) {
+        log_err("Calibration bundle has no camera %d!", camera);
+        return -1;
+    }
+    cam = &bundle->camera[camera];
+
+    if (cam->map_1.empty()) {
+        log_err("Calibration bundle has no remap tables for camera %d!", camera);
+        return -1;
+    } else if (src.size() != bundle->image_size) {
+        log_err(
+            "Frame size %dx%d does not match calibrated size %dx%d!",
+            src.cols,
+            src.rows,
+            bundle->image_size.width,
+            bundle->image_size.height
+        );
+        return -1;
+    }
+
+    cv::remap(src, dst, cam->map_1, cam->map_2, cv::INTER_LINEAR);
+    return 0;
+}
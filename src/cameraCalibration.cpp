@@ -1,19 +1,29 @@
 #include <iostream>
 #include <stdlib.h>
+#include <string.h>
 #include <sstream>
 #include <string>
+#include <vector>
 
 #include <opencv/highgui.h>
 #include <opencv/cv.h>
 
 #include <dbg/dbg.h>
 
+#include <eyes/calibrationBundle.hpp>
+#include <eyes/frameSource.hpp>
+#include <eyes/pixelFormat.hpp>
+#include <eyes/recording.hpp>
+#include <eyes/stats.hpp>
+
 #define GUI_WIDTH 400
 #define GUI_HEIGHT 400
 #define CALIBRATION_WINDOW "Calibration Window"
 #define LIVE_FEED_WINDOW "Live Feed Window"
 #define CALIBRATED_IMAGE "Calibrated Image"
 #define UNCALIBRATED_IMAGE "Un-calibrated Image"
+#define CALIBRATION_BUNDLE "calibration.bin"
+#define CALIBRATION_XML "calibration.xml"
 
 using namespace cv;
 using namespace std;
@@ -43,12 +53,15 @@ struct calibration
     CvMat *distortion_coeffs;
 };
 
-struct undistort_image
+struct stereo_chessboards
 {
-    IplImage *map_x;
-    IplImage *map_y;
-    IplImage *original_image;
-    IplImage *clone_image;
+    int skip_frames;            // wait frames per chessboard view
+    int boards_to_capture;      // number of views seen by both cameras
+    Size board_size;            // number of inner corners
+    Size image_size;
+
+    vector<vector<Point3f> > obj_pts;       // object points per view
+    vector<vector<Point2f> > img_pts[2];    // image points per view and camera
 };
 
 void init_chessboard(
@@ -94,10 +107,11 @@ void analyzeChessboardImage(
 {
     int step = 0;
     int j = 0;
+    STATS_SCOPE("chessboard");
 
-    // find chess board corners
+    // find chess board corners on the grey image the caller converted
     int found = cvFindChessboardCorners(
-        image,
+        gray_image,
         (*cb)->board_size,
         (*cb)->corners,
         &(*cb)->corner_count,
@@ -105,7 +119,6 @@ void analyzeChessboardImage(
     );
 
     // obtain subpixel accuracy on the corners
-    cvCvtColor(image, gray_image, CV_BGR2GRAY);
     cvFindCornerSubPix(
         gray_image,
         (*cb)->corners,
@@ -177,25 +190,40 @@ int listenForUserEvent()
 }
 
 int obtainChessboardImages(
-        CvCapture *capture,
-        IplImage *image,
+        FrameSource *source,
         IplImage *gray_image,
         struct chessboard_details *chessboard)
 {
 	int frame = 0;
 	int event = 0;
+	Frame feed;
+	Mat bgr;
+	Mat gray = cvarrToMat(gray_image);
+	IplImage image;
+	IplImage gray_header;
 
     cvNamedWindow(LIVE_FEED_WINDOW, CV_WINDOW_AUTOSIZE);
     cvNamedWindow(CALIBRATION_WINDOW, CV_WINDOW_AUTOSIZE);
 
 	while (chessboard->boards_captured < chessboard->boards_to_capture) {
-        image = cvQueryFrame(capture);
+        {
+            STATS_SCOPE("capture");
+            if (!source->read(feed)) {
+                return 1;
+            }
+        }
+        STATS_COUNT("frames", 1);
+        frameToBGR(feed, bgr);
+        image = bgr;
 
-        // skip every skip_frames frames to allow user to move chessboard
+        // skip every skip_frames frames to allow user to move chessboard,
+        // native capture formats hand over their Y plane as the grey image
 	    if (frame++ % chessboard->skip_frames == 0) {
+            frameToGray(feed, gray);
+            gray_header = gray;
             analyzeChessboardImage(
-                image,
-                gray_image,
+                &image,
+                &gray_header,
                 &chessboard
             );
         }
@@ -207,7 +235,7 @@ int obtainChessboardImages(
         }
 
         // display live feed
-        cvShowImage(LIVE_FEED_WINDOW, image);
+        cvShowImage(LIVE_FEED_WINDOW, &image);
 	}
 
 	cvDestroyWindow(LIVE_FEED_WINDOW);
@@ -277,56 +305,103 @@ struct calibration *analyzeFoundChessboardMatrices(
     return results;
 }
 
-void saveCalibrationResults(struct calibration *results)
+int saveCalibrationFiles(const struct calibration_bundle *bundle)
 {
-    cvSave("instrinsics.xml", results->intrinsic_matrix);
-    cvSave("distortion.xml", results->distortion_coeffs);
+    if (saveCalibrationBundle(CALIBRATION_BUNDLE, bundle) != 0) {
+        return -1;
+    }
+    log_info("Saved calibration bundle [%s]", CALIBRATION_BUNDLE);
+
+    if (exportCalibrationXML(CALIBRATION_XML, bundle) != 0) {
+        return -1;
+    }
+    log_info("Saved calibration settings [%s]", CALIBRATION_XML);
+
+    return 0;
 }
 
-void undistortImage(
-        struct undistort_image **undistort,
-        struct calibration *settings,
+int saveCalibrationResults(
+        struct calibration *results,
+        struct calibration_bundle *bundle,
         IplImage *image)
 {
-    (*undistort)->map_x = cvCreateImage(cvGetSize(image), IPL_DEPTH_32F, 1);
-    (*undistort)->map_y = cvCreateImage(cvGetSize(image), IPL_DEPTH_32F, 1);
-    cvInitUndistortMap(
-        settings->intrinsic_matrix,
-        settings->distortion_coeffs,
-        (*undistort)->map_x,
-        (*undistort)->map_y
+    initCalibrationBundle(bundle);
+    bundle->flags = BUNDLE_HAS_INTRINSICS;
+    bundle->num_cameras = 1;
+    bundle->image_size = cvGetSize(image);
+    cv::Mat(results->intrinsic_matrix).convertTo(
+        bundle->camera[0].intrinsics,
+        CV_64F
+    );
+    cv::Mat(results->distortion_coeffs).convertTo(
+        bundle->camera[0].distortion,
+        CV_64F
     );
+
+    // precompute remap tables so later runs can start undistorting straight
+    // from the bundle
+    if (computeRemapTables(bundle) != 0) {
+        return -1;
+    }
+
+    return saveCalibrationFiles(bundle);
+}
+
+int loadCalibrationSettings(
+        const char *bundle_path,
+        const char *xml_path,
+        struct calibration_bundle *bundle)
+{
+    log_info("Load calibration settings ...");
+    if (bundle_path) {
+        return loadCalibrationBundle(bundle_path, bundle);
+    }
+
+    // imported settings are turned into a bundle, so the programs that only
+    // load bundles can use them
+    if (importCalibrationXML(xml_path, bundle) != 0) {
+        return -1;
+    } else if (saveCalibrationBundle(CALIBRATION_BUNDLE, bundle) != 0) {
+        return -1;
+    }
+    log_info("Saved calibration bundle [%s]", CALIBRATION_BUNDLE);
+
+    return 0;
 }
 
 int displayCalibrationEffects(
-        CvCapture *capture,
-        IplImage *image,
-        struct undistort_image *undistort)
+        FrameSource *source,
+        struct calibration_bundle *bundle)
 {
     int event = 0;
+    Frame feed;
+    Mat image;
+    Mat calibrated;
 
     cvNamedWindow(UNCALIBRATED_IMAGE, CV_WINDOW_AUTOSIZE);
     cvNamedWindow(CALIBRATED_IMAGE, CV_WINDOW_AUTOSIZE);
 
     // display calibrated and uncalibrated image
-    while(image) {
+    while(source->read(feed)) {
         // image before calibration
-        IplImage *t = cvCloneImage(image);
-        cvShowImage(UNCALIBRATED_IMAGE, image);
+        frameToBGR(feed, image);
+        imshow(UNCALIBRATED_IMAGE, image);
 
         // image after calibration
-        cvRemap(t, image, undistort->map_x, undistort->map_y);
-        cvReleaseImage(&t);
-        cvShowImage(CALIBRATED_IMAGE, image);
+        {
+            STATS_SCOPE("remap");
+            if (rectifyFrame(bundle, 0, image, calibrated) != 0) {
+                return -1;
+            }
+        }
+        STATS_COUNT("frames", 1);
+        imshow(CALIBRATED_IMAGE, calibrated);
 
         // handle user events
         event = listenForUserEvent();
         if (event == 1) {  // quit?
             return 1;
         }
-
-        // get next frame image
-        image = cvQueryFrame(capture);
     }
 
 	cvDestroyWindow(UNCALIBRATED_IMAGE);
@@ -335,6 +410,255 @@ int displayCalibrationEffects(
     return 0;
 }
 
+
+// STEREO
+int obtainStereoChessboardImages(
+        vector<Ptr<FrameSource> > &sources,
+        FrameRecorder *recorder,
+        struct stereo_chessboards *cb)
+{
+    int frame = 0;
+    Frame feed[2];
+    Mat image[2];
+    Mat gray[2];
+    Mat pair;
+
+    cvNamedWindow(LIVE_FEED_WINDOW, CV_WINDOW_AUTOSIZE);
+
+    while ((int) cb->obj_pts.size() < cb->boards_to_capture) {
+        vector<Point2f> corners[2];
+        bool found = true;
+
+        {
+            STATS_SCOPE("capture");
+            if (!sources[0]->read(feed[0]) || !sources[1]->read(feed[1])) {
+                return 1;
+            }
+        }
+        STATS_COUNT("frames", 1);
+        if (recorder) {
+            recorder->record(feed[0], feed[1]);
+        }
+        frameToBGR(feed[0], image[0]);
+        frameToBGR(feed[1], image[1]);
+        if (image[0].size() != image[1].size()) {
+            log_err("Stereo sources have different frame sizes!");
+            return -1;
+        }
+        cb->image_size = image[0].size();
+
+        // a view only counts when the whole board is seen by both cameras
+        if (frame++ % cb->skip_frames == 0) {
+            STATS_SCOPE("chessboard");
+
+            for (int i = 0; i < 2 && found; i++) {
+                frameToGray(feed[i], gray[i]);
+                found = findChessboardCorners(
+                    gray[i],
+                    cb->board_size,
+                    corners[i],
+                    CALIB_CB_ADAPTIVE_THRESH | CALIB_CB_FILTER_QUADS
+                );
+            }
+
+            if (found) {
+                vector<Point3f> obj_pts;
+
+                for (int i = 0; i < 2; i++) {
+                    cornerSubPix(
+                        gray[i],
+                        corners[i],
+                        Size(11, 11),
+                        Size(-1, -1),
+                        TermCriteria(CV_TERMCRIT_EPS + CV_TERMCRIT_ITER, 30, 0.1)
+                    );
+                    drawChessboardCorners(image[i], cb->board_size, corners[i], found);
+                    cb->img_pts[i].push_back(corners[i]);
+                }
+                for (int j = 0; j < cb->board_size.area(); j++) {
+                    obj_pts.push_back(Point3f(
+                        j % cb->board_size.width,
+                        j / cb->board_size.width,
+                        0.0f
+                    ));
+                }
+                cb->obj_pts.push_back(obj_pts);
+                log_info("Boards captured: %d", (int) cb->obj_pts.size());
+            }
+        }
+
+        // handle user events
+        if (listenForUserEvent() == 1) {  // quit?
+            return 1;
+        }
+
+        // display both live feeds side by side
+        hconcat(image[0], image[1], pair);
+        imshow(LIVE_FEED_WINDOW, pair);
+    }
+
+    cvDestroyWindow(LIVE_FEED_WINDOW);
+
+    return 0;
+}
+
+int calibrateStereoChessboards(
+        struct stereo_chessboards *cb,
+        struct calibration_bundle *bundle)
+{
+    vector<Mat> rvecs;
+    vector<Mat> tvecs;
+    Mat essential;
+    Mat fundamental;
+    double error;
+
+    initCalibrationBundle(bundle);
+    bundle->flags = BUNDLE_HAS_INTRINSICS | BUNDLE_HAS_STEREO;
+    bundle->num_cameras = 2;
+    bundle->image_size = cb->image_size;
+
+    // calibrate each camera on its own, the stereo solve then only has to
+    // find the extrinsics between them
+    for (int i = 0; i < 2; i++) {
+        struct camera_calibration *cam = &bundle->camera[i];
+
+        cam->intrinsics = Mat::eye(3, 3, CV_64F);
+        cam->distortion = Mat::zeros(5, 1, CV_64F);
+        error = calibrateCamera(
+            cb->obj_pts,
+            cb->img_pts[i],
+            cb->image_size,
+            cam->intrinsics,
+            cam->distortion,
+            rvecs,
+            tvecs
+        );
+        log_info("Camera %d reprojection error: %f", i + 1, error);
+    }
+
+    error = stereoCalibrate(
+        cb->obj_pts,
+        cb->img_pts[0],
+        cb->img_pts[1],
+        bundle->camera[0].intrinsics,
+        bundle->camera[0].distortion,
+        bundle->camera[1].intrinsics,
+        bundle->camera[1].distortion,
+        cb->image_size,
+        bundle->rotation,
+        bundle->translation,
+        essential,
+        fundamental,
+        TermCriteria(TermCriteria::COUNT + TermCriteria::EPS, 100, 1e-5),
+        CALIB_FIX_INTRINSIC
+    );
+    log_info("Stereo reprojection error: %f", error);
+
+    // rectification, disparity to depth and remap tables follow from the
+    // extrinsics
+    return computeRemapTables(bundle);
+}
+
+int displayStereoRectification(
+        vector<Ptr<FrameSource> > &sources,
+        FrameRecorder *recorder,
+        struct calibration_bundle *bundle)
+{
+    Frame feed[2];
+    Mat image[2];
+    Mat rectified[2];
+    Mat pair;
+
+    cvNamedWindow(CALIBRATED_IMAGE, CV_WINDOW_AUTOSIZE);
+
+    while (sources[0]->read(feed[0]) && sources[1]->read(feed[1])) {
+        if (recorder) {
+            recorder->record(feed[0], feed[1]);
+        }
+
+        {
+            STATS_SCOPE("remap");
+            for (int i = 0; i < 2; i++) {
+                frameToBGR(feed[i], image[i]);
+                if (rectifyFrame(bundle, i, image[i], rectified[i]) != 0) {
+                    return -1;
+                }
+            }
+        }
+        STATS_COUNT("frames", 1);
+
+        // rows of a rectified pair line up, the lines make that easy to see
+        hconcat(rectified[0], rectified[1], pair);
+        for (int y = 0; y < pair.rows; y += 32) {
+            line(pair, Point(0, y), Point(pair.cols, y), Scalar(0, 255, 0));
+        }
+        imshow(CALIBRATED_IMAGE, pair);
+
+        // handle user events
+        if (listenForUserEvent() == 1) {  // quit?
+            return 1;
+        }
+    }
+
+    cvDestroyWindow(CALIBRATED_IMAGE);
+
+    return 0;
+}
+
+int runStereoCalibration(
+        const vector<string> &specs,
+        const char *bundle_path,
+        const char *xml_path,
+        const char *record_path)
+{
+    vector<Ptr<FrameSource> > sources;
+    Ptr<FrameRecorder> recorder;
+    struct stereo_chessboards cb;
+    struct calibration_bundle bundle;
+    int event = 0;
+
+    initCalibrationBundle(&bundle);
+    for (size_t i = 0; i < specs.size(); i++) {
+        sources.push_back(openFrameSource(specs[i], Size(640, 480)));
+        if (sources.back().empty()) return -1;
+    }
+
+    // record raw stereo pairs before chessboard corners are drawn on them
+    if (record_path) {
+        recorder = new FrameRecorder(record_path, 2);
+        if (!recorder->isOpened()) return -1;
+    }
+
+    if (bundle_path || xml_path) {
+        // existing calibration, skip straight to rectifying
+        if (loadCalibrationSettings(bundle_path, xml_path, &bundle) != 0) {
+            return -1;
+        } else if ((bundle.flags & BUNDLE_HAS_STEREO) == 0) {
+            log_err("Calibration bundle is not a stereo calibration!");
+            return -1;
+        }
+    } else {
+        cb.skip_frames = 20;
+        cb.boards_to_capture = 10;
+        cb.board_size = Size(9, 6);
+
+        log_info("Obtain stereo chessboard images ...");
+        event = obtainStereoChessboardImages(sources, recorder, &cb);
+        if (event == 1) return 0;
+        if (event != 0) return -1;
+
+        log_info("Analyze stereo chessboard images for calibration settings ...");
+        if (calibrateStereoChessboards(&cb, &bundle) != 0) return -1;
+        if (saveCalibrationFiles(&bundle) != 0) return -1;
+    }
+
+    log_info("Display rectified stereo pair ...");
+    event = displayStereoRectification(sources, recorder, &bundle);
+    releaseCalibrationBundle(&bundle);
+
+    return event == -1 ? -1 : 0;
+}
+
 int main(int argc, char* argv[])
 {
     // general vars
@@ -343,27 +667,98 @@ int main(int argc, char* argv[])
 	int event = 0;
 	struct chessboard_details *chessboard = new chessboard_details();
 	struct calibration *results;
-	struct undistort_image *undistort = new undistort_image();
+	struct calibration_bundle bundle;
+	const char *bundle_path = NULL;
+	const char *xml_path = NULL;
+	vector<string> source_specs;
+	bool stereo = false;
+	const char *record_path = NULL;
 
     // camera and image vars
-	CvCapture *capture;
-	Mat camera_feed;
+	Ptr<FrameSource> source;
+	Frame first_frame;
+	Mat first_bgr;
+	IplImage first_image;
     IplImage *image;
     IplImage *gray_image;
 
+    // parse arguments
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--load") == 0 && i + 1 < argc) {
+            bundle_path = argv[++i];
+        } else if (strcmp(argv[i], "--import") == 0 && i + 1 < argc) {
+            xml_path = argv[++i];
+        } else if (strcmp(argv[i], "--source") == 0 && i + 1 < argc) {
+            source_specs.push_back(argv[++i]);
+        } else if (strcmp(argv[i], "--stereo") == 0) {
+            stereo = true;
+        } else if (strcmp(argv[i], "--stats") == 0 && i + 1 < argc) {
+            statsStart(argv[++i]);
+        } else if (strcmp(argv[i], "--record") == 0 && i + 1 < argc) {
+            record_path = argv[++i];
+        } else {
+            log_err(
+                "Usage: %s [--stereo] [--source <spec>] [--load <bundle>] "
+                "[--import <xml>] [--stats <file>] [--record <file>]",
+                argv[0]
+            );
+            return -1;
+        }
+    }
+    initCalibrationBundle(&bundle);
+
+    // stereo calibration takes a left and a right source
+    if (source_specs.empty()) {
+        source_specs.push_back("camera:0");
+        if (stereo) {
+            source_specs.push_back("camera:1");
+        }
+    }
+    if (source_specs.size() != (stereo ? 2u : 1u)) {
+        log_err("Calibration takes 1 source, or 2 with --stereo!");
+        return -1;
+    }
 
+    if (stereo) {
+        log_info("Starting Stereo Camera Calibration!");
+        return runStereoCalibration(source_specs, bundle_path, xml_path, record_path);
+    }
 
     // START PROGRAM
     log_info("Starting Camera Calibration!");
     log_info("Opening camera stream ...");
 
     // init video camera
-    capture = cvCreateCameraCapture(0);
+    source = openFrameSource(source_specs[0], Size(640, 480));
+    if (source.empty()) return -1;
+
+    // record raw frames before chessboard corners are drawn on them
+    if (record_path) {
+        source = new RecordingSource(source, record_path);
+        if (!source->isOpened()) return -1;
+    }
 
     // init images
-    image = cvQueryFrame(capture);
+    if (!source->read(first_frame)) {
+        log_err("Failed to read first frame!");
+        return -1;
+    }
+    frameToBGR(first_frame, first_bgr);
+    first_image = first_bgr;
+    image = &first_image;
     gray_image = cvCreateImage(cvGetSize(image), 8, 1);
 
+    // existing calibration, skip straight to undistorting
+    if (bundle_path || xml_path) {
+        event = loadCalibrationSettings(bundle_path, xml_path, &bundle);
+        if (event != 0) return -1;
+
+        log_info("Display calibration effects...");
+        event = displayCalibrationEffects(source, &bundle);
+        releaseCalibrationBundle(&bundle);
+        return event == -1 ? -1 : 0;
+    }
+
     // init chessboard
 	init_chessboard(
         &chessboard,
@@ -375,8 +770,7 @@ int main(int argc, char* argv[])
     // obtain chessboard images
     log_info("Obtain chessboard images ...");
     event = obtainChessboardImages(
-        capture,
-        image,
+        source,
         gray_image,
         chessboard
     );
@@ -385,16 +779,13 @@ int main(int argc, char* argv[])
 	// analyze images for calibration and save results
     log_info("Analyze chessboard images for calibration settings ...");
     results = analyzeFoundChessboardMatrices(&chessboard, image);
-    saveCalibrationResults(results);
-
-    // load calibration settings
-    log_info("Load calibration settings ...");
-    undistortImage(&undistort, results, image);
+    event = saveCalibrationResults(results, &bundle, image);
+    if (event != 0) return -1;
 
     // display calibration effects
     log_info("Display calibration effects...");
-    event = displayCalibrationEffects(capture, image, undistort);
-    if (event == 1) return 0;
+    event = displayCalibrationEffects(source, &bundle);
+    if (event == -1) return -1;
 
 	return 0;
 }
@@ -0,0 +1,127 @@
+#include <algorithm>
+#include <vector>
+
+#include <opencv2/core/core.hpp>
+#include <opencv2/calib3d/calib3d.hpp>
+
+#include <eyes/disparity.hpp>
+#include <eyes/stats.hpp>
+
+cv::StereoBM initDisparityCalculator() {
+    cv::StereoBM bm(CV_STEREO_BM_BASIC);
+
+    bm.state->SADWindowSize = 5;
+    bm.state->numberOfDisparities = 96;
+    bm.state->preFilterSize = 25;
+    bm.state->preFilterCap = 63;
+    bm.state->minDisparity = 0;
+    bm.state->textureThreshold = 20;
+    bm.state->uniquenessRatio = 10;
+    bm.state->speckleWindowSize = 25;
+    bm.state->speckleRange = 32;
+    bm.state->disp12MaxDiff = 1;
+
+    return bm;
+}
+
+cv::Mat calculateDisparity(
+    cv::StereoBM bm,
+    cv::Mat left,
+    cv::Mat right)
+{
+    cv::Size size = left.size();
+    cv::Mat disparity_map = cv::Mat(size, CV_16SC1);
+    cv::Mat left_converted;
+    cv::Mat right_converted;
+    STATS_SCOPE("disparity");
+
+    // calculate disparity map
+    bm(left, right, disparity_map);
+
+    return disparity_map;
+}
+
+void calculateDisparityRows(
+    cv::StereoBM bm,
+    cv::Mat left,
+    cv::Mat right,
+    cv::Range rows,
+    cv::Mat &disparity_map)
+{
+    int reach = bm.state->SADWindowSize / 2 + bm.state->preFilterSize / 2;
+    cv::Range band(
+        std::max(rows.start - reach, 0),
+        std::min(rows.end + reach, left.rows)
+    );
+    cv::Mat band_map;
+    STATS_SCOPE("disparity_rows");
+
+    bm(left.rowRange(band), right.rowRange(band), band_map);
+    band_map.rowRange(rows.start - band.start, rows.end - band.start)
+        .copyTo(disparity_map.rowRange(rows));
+}
+
+int calculateRoiDisparity(
+    cv::StereoBM bm,
+    cv::Mat left,
+    cv::Mat right,
+    cv::Rect roi,
+    float &disparity)
+{
+    int window = bm.state->SADWindowSize / 2 + bm.state->preFilterSize / 2;
+    int search = bm.state->minDisparity + bm.state->numberOfDisparities;
+    int invalid = (bm.state->minDisparity - 1) * 16;
+    cv::Rect bounds(0, 0, left.cols, left.rows);
+    cv::Rect strip;
+    cv::Mat strip_map;
+    cv::Mat roi_map;
+    std::vector<short> valid;
+    STATS_SCOPE("disparity_roi");
+
+    // a left pixel at x matches right pixels down to x - search, and block
+    // matching leaves the first search columns of its input unmatched
+    roi &= cv::Rect(search, 0, left.cols - search, left.rows);
+    if (roi.area() == 0) {
+        return 0;
+    }
+    strip = cv::Rect(
+        roi.x - search - window,
+        roi.y - window,
+        roi.width + search + 2 * window,
+        roi.height + 2 * window
+    ) & bounds;
+    if (strip.height < bm.state->SADWindowSize) {
+        return 0;
+    }
+
+    bm(left(strip), right(strip), strip_map);
+    roi_map = strip_map(roi - strip.tl());
+
+    for (int y = 0; y < roi_map.rows; y++) {
+        const short *row = roi_map.ptr<short>(y);
+
+        for (int x = 0; x < roi_map.cols; x++) {
+            if (row[x] > invalid) {
+                valid.push_back(row[x]);
+            }
+        }
+    }
+    if (valid.empty()) {
+        return 0;
+    }
+
+    // median is robust against the background caught in the bounding box
+    std::nth_element(valid.begin(), valid.begin() + valid.size() / 2, valid.end());
+    disparity = valid[valid.size() / 2] / 16.0f;
+
+    return valid.size();
+}
+
+cv::Point3f disparityToPoint(const cv::Mat &Q, cv::Point2f point, float disparity)
+{
+    std::vector<cv::Point3f> src(1, cv::Point3f(point.x, point.y, disparity));
+    std::vector<cv::Point3f> dst;
+
+    cv::perspectiveTransform(src, dst, Q);
+    return dst[0];
+}
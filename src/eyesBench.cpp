@@ -0,0 +1,538 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include <opencv2/core/core.hpp>
+#include <opencv2/imgproc/imgproc.hpp>
+#include <opencv2/calib3d/calib3d.hpp>
+
+#include <dbg/dbg.h>
+
+#include <eyes/calibrationBundle.hpp>
+#include <eyes/disparity.hpp>
+#include <eyes/frameSource.hpp>
+#include <eyes/histogramTracker.hpp>
+#include <eyes/motionGate.hpp>
+#include <eyes/pixelFormat.hpp>
+#include <eyes/tracking.hpp>
+
+#define BENCH_FRAMES 16
+#define CHESSBOARD_WIDTH 9
+#define CHESSBOARD_HEIGHT 6
+
+struct bench_options
+{
+    int iterations;
+    int warmup;
+    std::string input;
+    std::string input_right;
+    std::string output;
+    std::string filter;
+};
+
+struct bench_result
+{
+    std::string name;
+    cv::Size resolution;
+    std::vector<double> samples;    // microseconds per iteration
+};
+
+// Frames preloaded into memory and replayed in a loop, so end to end
+// benchmarks measure the pipeline and not the disk or camera.
+class MemorySource : public FrameSource
+{
+public:
+    explicit MemorySource(const std::vector<cv::Mat> &frames)
+        : frames(frames), index(0) {}
+
+    bool isOpened() const { return !frames.empty(); }
+    cv::Size size() const { return frames[0].size(); }
+    std::string name() const { return "memory"; }
+
+    bool read(Frame &frame)
+    {
+        const cv::Mat &image = frames[index++ % frames.size()];
+
+        frame = nextFrame(image.size(), image.type());
+        image.copyTo(frame.image);
+        return true;
+    }
+
+private:
+    std::vector<cv::Mat> frames;
+    size_t index;
+};
+
+static const cv::Size resolutions[] = {
+    cv::Size(320, 240),     // QVGA
+    cv::Size(400, 300),     // objectTracking default
+    cv::Size(1280, 720),    // 720p
+    cv::Size(1920, 1080)    // 1080p
+};
+
+// HSV range matching the ball of the synthetic scene
+static const cv::Scalar hsv_min(0, 100, 100);
+static const cv::Scalar hsv_max(10, 256, 256);
+
+static std::vector<struct bench_result> results;
+
+
+// INPUTS
+static std::vector<cv::Mat> loadFrames(
+    const std::string &spec,
+    cv::Size resolution,
+    int shift)
+{
+    std::vector<cv::Mat> frames;
+    cv::Ptr<FrameSource> source;
+    Frame frame;
+
+    if (spec.empty()) {
+        source = new SyntheticSource(resolution, shift);
+    } else {
+        source = openFrameSource(spec, resolution);
+    }
+
+    while (!source.empty() && (int) frames.size() < BENCH_FRAMES) {
+        cv::Mat bgr;
+        cv::Mat resized;
+
+        if (!source->read(frame)) {
+            break;
+        }
+
+        // raw input and native recordings come in their capture format,
+        // the benchmarks work on BGR
+        frameToBGR(frame, bgr);
+        cv::resize(bgr, resized, resolution);
+
+        // recorded input has a single view, shift it the way the synthetic
+        // scene shifts, so stereo benchmarks match on a real disparity
+        if (!spec.empty() && shift > 0) {
+            cv::Mat shifted;
+
+            cv::copyMakeBorder(
+                resized(cv::Rect(shift, 0, resolution.width - shift, resolution.height)),
+                shifted,
+                0,
+                0,
+                0,
+                shift,
+                cv::BORDER_REPLICATE
+            );
+            resized = shifted;
+        }
+        frames.push_back(resized);
+    }
+
+    return frames;
+}
+
+static cv::Mat renderChessboard(cv::Size resolution)
+{
+    int square = std::min(
+        resolution.width / (CHESSBOARD_WIDTH + 3),
+        resolution.height / (CHESSBOARD_HEIGHT + 3)
+    );
+    cv::Point origin(
+        (resolution.width - square * (CHESSBOARD_WIDTH + 1)) / 2,
+        (resolution.height - square * (CHESSBOARD_HEIGHT + 1)) / 2
+    );
+    cv::Mat board(resolution, CV_8UC3, cv::Scalar::all(255));
+
+    for (int y = 0; y < CHESSBOARD_HEIGHT + 1; y++) {
+        for (int x = 0; x < CHESSBOARD_WIDTH + 1; x++) {
+            if ((x + y) % 2 == 0) {
+                cv::rectangle(
+                    board,
+                    origin + cv::Point(x * square, y * square),
+                    origin + cv::Point((x + 1) * square - 1, (y + 1) * square - 1),
+                    cv::Scalar::all(0),
+                    -1
+                );
+            }
+        }
+    }
+
+    return board;
+}
+
+static void syntheticCalibration(
+    cv::Size resolution,
+    struct calibration_bundle *bundle)
+{
+    double f = resolution.width;
+
+    initCalibrationBundle(bundle);
+    bundle->flags = BUNDLE_HAS_INTRINSICS;
+    bundle->num_cameras = 1;
+    bundle->image_size = resolution;
+    bundle->camera[0].intrinsics = (cv::Mat_<double>(3, 3) <<
+        f, 0, resolution.width / 2.0,
+        0, f, resolution.height / 2.0,
+        0, 0, 1
+    );
+    bundle->camera[0].distortion = (cv::Mat_<double>(5, 1) <<
+        -0.2, 0.05, 0, 0, 0
+    );
+    computeRemapTables(bundle);
+}
+
+
+// RUNNER
+static void runBench(
+    const struct bench_options &options,
+    const std::string &name,
+    cv::Size resolution,
+    std::function<void (int)> prepare,
+    std::function<void (int)> run)
+{
+    struct bench_result result;
+
+    if (!options.filter.empty() && name.find(options.filter) == std::string::npos) {
+        return;
+    }
+
+    for (int i = 0; i < options.warmup; i++) {
+        prepare(i);
+        run(i);
+    }
+
+    for (int i = 0; i < options.iterations; i++) {
+        prepare(i);
+
+        std::chrono::steady_clock::time_point start =
+            std::chrono::steady_clock::now();
+        run(i);
+        result.samples.push_back(
+            std::chrono::duration<double, std::micro>(
+                std::chrono::steady_clock::now() - start
+            ).count()
+        );
+    }
+
+    result.name = name;
+    result.resolution = resolution;
+    results.push_back(result);
+    log_info(
+        "%-24s %4dx%-4d %10.1f us",
+        name.c_str(),
+        resolution.width,
+        resolution.height,
+        cv::mean(result.samples)[0]
+    );
+}
+
+static void nothing(int)
+{
+}
+
+static void benchResolution(
+    const struct bench_options &options,
+    cv::Size resolution)
+{
+    std::vector<cv::Mat> frames;
+    std::vector<cv::Mat> frames_right;
+    std::vector<cv::Mat> hsv;
+    std::vector<cv::Mat> thresh;
+    std::vector<cv::Mat> morphed;
+    std::vector<cv::Mat> gray;
+    std::vector<cv::Mat> gray_right;
+    std::vector<Frame> yuyv;
+    std::vector<Frame> nv12;
+    struct calibration_bundle bundle;
+    cv::StereoBM bm = initDisparityCalculator();
+    cv::Mat chessboard = renderChessboard(resolution);
+    cv::Mat work;
+    cv::Mat work_2;
+    cv::Mat feed;
+    int x = 0;
+    int y = 0;
+
+    frames = loadFrames(options.input, resolution, 0);
+    frames_right = options.input_right.empty()
+        ? loadFrames(options.input, resolution, resolution.width / 40)
+        : loadFrames(options.input_right, resolution, 0);
+    if (frames.empty() || frames_right.empty()) {
+        log_err("No input frames for %dx%d!", resolution.width, resolution.height);
+        return;
+    }
+
+    // intermediate results feeding the per kernel benchmarks
+    for (size_t i = 0; i < frames.size(); i++) {
+        cv::Mat h, t, m, g, g_right;
+
+        cv::cvtColor(frames[i], h, cv::COLOR_BGR2HSV);
+        cv::inRange(h, hsv_min, hsv_max, t);
+        t.copyTo(m);
+        morphOps(m);
+        cv::cvtColor(frames[i], g, CV_BGR2GRAY);
+        cv::cvtColor(frames_right[i % frames_right.size()], g_right, CV_BGR2GRAY);
+
+        Frame f;
+        f.format = FORMAT_YUYV;
+        convertFromBGR(frames[i], FORMAT_YUYV, f.image);
+        yuyv.push_back(f);
+        f = Frame();
+        f.format = FORMAT_NV12;
+        convertFromBGR(frames[i], FORMAT_NV12, f.image);
+        nv12.push_back(f);
+
+        hsv.push_back(h);
+        thresh.push_back(t);
+        morphed.push_back(m);
+        gray.push_back(g);
+        gray_right.push_back(g_right);
+    }
+    syntheticCalibration(resolution, &bundle);
+
+    size_t n = frames.size();
+
+    // KERNELS
+    runBench(options, "hsv_convert", resolution, nothing, [&](int i) {
+        cv::cvtColor(frames[i % n], work, cv::COLOR_BGR2HSV);
+    });
+
+    // native capture formats, against decoding to BGR first
+    runBench(options, "yuyv_decode_gray", resolution, nothing, [&](int i) {
+        cv::cvtColor(yuyv[i % n].image, work_2, cv::COLOR_YUV2BGR_YUYV);
+        cv::cvtColor(work_2, work, CV_BGR2GRAY);
+    });
+
+    runBench(options, "yuyv_to_gray", resolution, nothing, [&](int i) {
+        frameToGray(yuyv[i % n], work);
+    });
+
+    runBench(options, "nv12_to_gray", resolution, nothing, [&](int i) {
+        frameToGray(nv12[i % n], work);
+    });
+
+    runBench(options, "yuyv_decode_hsv", resolution, nothing, [&](int i) {
+        cv::cvtColor(yuyv[i % n].image, work_2, cv::COLOR_YUV2BGR_YUYV);
+        cv::cvtColor(work_2, work, cv::COLOR_BGR2HSV);
+    });
+
+    runBench(options, "yuyv_to_hsv", resolution, nothing, [&](int i) {
+        frameToHSV(yuyv[i % n], work);
+    });
+
+    runBench(options, "nv12_to_hsv", resolution, nothing, [&](int i) {
+        frameToHSV(nv12[i % n], work);
+    });
+
+    runBench(options, "in_range", resolution, nothing, [&](int i) {
+        cv::inRange(hsv[i % n], hsv_min, hsv_max, work);
+    });
+
+    runBench(options, "morph_ops", resolution, [&](int i) {
+        thresh[i % n].copyTo(work);
+    }, [&](int) {
+        morphOps(work);
+    });
+
+    runBench(options, "track_filtered_object", resolution, [&](int i) {
+        frames[i % n].copyTo(feed);
+    }, [&](int i) {
+        trackFilteredObject(x, y, morphed[i % n], feed);
+    });
+
+    runBench(options, "track_pyramid", resolution, nothing, [&](int i) {
+        std::vector<struct tracked_object> objects;
+        trackPyramid(frames[i % n], hsv_min, hsv_max, true, objects);
+    });
+
+    std::vector<struct tracked_object> roi_objects;
+    findFilteredObjects(morphed[0], roi_objects);
+    runBench(options, "calculate_roi_disparity", resolution, nothing, [&](int i) {
+        float disparity;
+
+        for (size_t o = 0; o < roi_objects.size(); o++) {
+            calculateRoiDisparity(
+                bm,
+                gray[i % n],
+                gray_right[i % n],
+                roi_objects[o].bounds,
+                disparity
+            );
+        }
+    });
+
+    // learn the ball of the first frame, then follow it
+    HistogramTracker tracker;
+    std::vector<struct tracked_object> learn_objects;
+    findFilteredObjects(morphed[0], learn_objects);
+    if (!learn_objects.empty()) {
+        tracker.learn(frames[0], learn_objects[0].bounds);
+        runBench(options, "camshift", resolution, nothing, [&](int i) {
+            tracker.track(frames[i % n]);
+        });
+    }
+
+    MotionGate gate;
+    runBench(options, "motion_gate", resolution, nothing, [&](int i) {
+        gate.update(frames[i % n]);
+    });
+
+    runBench(options, "calculate_disparity", resolution, nothing, [&](int i) {
+        work = calculateDisparity(bm, gray[i % n], gray_right[i % n]);
+    });
+
+    runBench(options, "chessboard_detect", resolution, nothing, [&](int) {
+        std::vector<cv::Point2f> corners;
+        bool found = cv::findChessboardCorners(
+            chessboard,
+            cv::Size(CHESSBOARD_WIDTH, CHESSBOARD_HEIGHT),
+            corners,
+            CV_CALIB_CB_ADAPTIVE_THRESH | CV_CALIB_CB_FILTER_QUADS
+        );
+
+        if (found) {
+            cv::cvtColor(chessboard, work, CV_BGR2GRAY);
+            cv::cornerSubPix(
+                work,
+                corners,
+                cv::Size(11, 11),
+                cv::Size(-1, -1),
+                cv::TermCriteria(CV_TERMCRIT_EPS + CV_TERMCRIT_ITER, 30, 0.1)
+            );
+        }
+    });
+
+    runBench(options, "undistort_remap", resolution, nothing, [&](int i) {
+        rectifyFrame(&bundle, 0, frames[i % n], work);
+    });
+
+    // END TO END
+    MemorySource tracking_source(frames);
+    runBench(options, "e2e_objectTracking", resolution, nothing, [&](int) {
+        Frame frame;
+
+        tracking_source.read(frame);
+        cv::cvtColor(frame.image, work, cv::COLOR_BGR2HSV);
+        cv::inRange(work, hsv_min, hsv_max, work_2);
+        morphOps(work_2);
+        trackFilteredObject(x, y, work_2, frame.image);
+    });
+
+    // static scene, everything after the gate is skipped
+    MotionGate static_gate;
+    cv::Mat static_hsv;
+    cv::Mat static_thresh;
+    std::vector<cv::Mat> static_frames(1, frames[0]);
+    MemorySource static_source(static_frames);
+    runBench(options, "e2e_objectTracking_static_gated", resolution, nothing, [&](int) {
+        Frame frame;
+
+        static_source.read(frame);
+        if (static_gate.update(frame.image) > 0) {
+            thresholdRegions(
+                frame.image,
+                static_gate.changedRegions(MORPH_REACH),
+                hsv_min,
+                hsv_max,
+                true,
+                static_hsv,
+                static_thresh
+            );
+            trackFilteredObject(x, y, static_thresh, frame.image);
+        }
+    });
+
+    MemorySource left_source(frames);
+    MemorySource right_source(frames_right);
+    runBench(options, "e2e_stereoVision", resolution, nothing, [&](int) {
+        Frame left;
+        Frame right;
+
+        left_source.read(left);
+        right_source.read(right);
+        cv::cvtColor(left.image, work, CV_BGR2GRAY);
+        cv::cvtColor(right.image, work_2, CV_BGR2GRAY);
+        feed = calculateDisparity(bm, work, work_2);
+    });
+
+    MemorySource calibration_source(frames);
+    runBench(options, "e2e_cameraCalibration", resolution, nothing, [&](int) {
+        Frame frame;
+
+        calibration_source.read(frame);
+        rectifyFrame(&bundle, 0, frame.image, work);
+    });
+}
+
+
+// OUTPUT
+static int writeResults(const std::string &path)
+{
+    FILE *fp = path.empty() ? stdout : fopen(path.c_str(), "w");
+
+    if (fp == NULL) {
+        log_err("Failed to open [%s] for writing!", path.c_str());
+        return -1;
+    }
+
+    fprintf(fp, "{\n  \"benchmarks\": [");
+    for (size_t i = 0; i < results.size(); i++) {
+        std::vector<double> samples = results[i].samples;
+        double mean = cv::mean(samples)[0];
+
+        std::sort(samples.begin(), samples.end());
+        fprintf(fp, "%s\n    {", i ? "," : "");
+        fprintf(fp, "\"name\": \"%s\", ", results[i].name.c_str());
+        fprintf(fp, "\"width\": %d, ", results[i].resolution.width);
+        fprintf(fp, "\"height\": %d, ", results[i].resolution.height);
+        fprintf(fp, "\"iterations\": %d, ", (int) samples.size());
+        fprintf(fp, "\"mean_us\": %.3f, ", mean);
+        fprintf(fp, "\"min_us\": %.3f, ", samples.front());
+        fprintf(fp, "\"p50_us\": %.3f, ", samples[samples.size() / 2]);
+        fprintf(fp, "\"p99_us\": %.3f, ", samples[samples.size() * 99 / 100]);
+        fprintf(fp, "\"fps\": %.2f}", mean > 0 ? 1e6 / mean : 0.0);
+    }
+    fprintf(fp, "\n  ]\n}\n");
+
+    if (fp != stdout) {
+        fclose(fp);
+    }
+
+    return 0;
+}
+
+int main(int argc, char* argv[])
+{
+    struct bench_options options;
+    options.iterations = 100;
+    options.warmup = 5;
+
+    // parse arguments
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--iterations") == 0 && i + 1 < argc) {
+            options.iterations = std::max(1, atoi(argv[++i]));
+        } else if (strcmp(argv[i], "--input") == 0 && i + 1 < argc) {
+            options.input = argv[++i];
+        } else if (strcmp(argv[i], "--input-right") == 0 && i + 1 < argc) {
+            options.input_right = argv[++i];
+        } else if (strcmp(argv[i], "--output") == 0 && i + 1 < argc) {
+            options.output = argv[++i];
+        } else if (strcmp(argv[i], "--filter") == 0 && i + 1 < argc) {
+            options.filter = argv[++i];
+        } else {
+            log_err(
+                "Usage: %s [--iterations <n>] [--input <spec>] "
+                "[--input-right <spec>] [--output <file>] [--filter <name>]",
+                argv[0]
+            );
+            return -1;
+        }
+    }
+
+    for (size_t i = 0; i < sizeof(resolutions) / sizeof(resolutions[0]); i++) {
+        benchResolution(options, resolutions[i]);
+    }
+
+    return writeResults(options.output);
+}
@@ -0,0 +1,633 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <ctype.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <mutex>
+#include <sstream>
+#include <algorithm>
+
+#include <opencv2/core/core.hpp>
+#include <opencv2/imgproc/imgproc.hpp>
+#include <opencv2/highgui/highgui.hpp>
+
+#include <dbg/dbg.h>
+
+#include <eyes/frameSource.hpp>
+#include <eyes/recording.hpp>
+#include <eyes/stats.hpp>
+
+static int64_t timestampNow()
+{
+    return (int64_t) (cv::getTickCount() * 1e6 / cv::getTickFrequency());
+}
+
+// The capture backends are not documented as thread safe and keep global
+// state while a capture is created (V4L numbers its cameras in globals), so
+// captures are created one at a time. The format and size negotiation that
+// follows runs concurrently.
+static std::mutex &captureLock()
+{
+    static std::mutex lock;
+    return lock;
+}
+
+
+// FRAME POOL
+FramePool::FramePool(size_t capacity)
+    : state(new State())
+{
+    state->capacity = capacity;
+}
+
+Frame FramePool::acquire(cv::Size size, int type)
+{
+    Frame frame;
+    cv::Mat buffer;
+
+    {
+        std::lock_guard<std::mutex> guard(state->lock);
+
+        // reuse a free buffer of the right shape, drop stale ones
+        while (!state->free.empty() && buffer.empty()) {
+            cv::Mat candidate = state->free.back();
+            state->free.pop_back();
+
+            if (candidate.size() == size && candidate.type() == type) {
+                buffer = candidate;
+            }
+        }
+    }
+
+    if (buffer.empty()) {
+        buffer.create(size, type);
+    }
+
+    std::weak_ptr<State> owner = state;
+    frame.image = buffer;
+    frame.buffer = std::shared_ptr<void>(
+        buffer.data,
+        [owner, buffer](void *) { FramePool::recycle(owner, buffer); }
+    );
+
+    return frame;
+}
+
+size_t FramePool::available() const
+{
+    std::lock_guard<std::mutex> guard(state->lock);
+    return state->free.size();
+}
+
+void FramePool::recycle(std::weak_ptr<State> state, cv::Mat buffer)
+{
+    std::shared_ptr<State> pool = state.lock();
+
+    // pool is gone, the buffer is freed with the last Mat reference
+    if (!pool) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> guard(pool->lock);
+    if (pool->free.size() < pool->capacity) {
+        pool->free.push_back(buffer);
+    }
+}
+
+
+// FRAME SOURCE
+Frame FrameSource::nextFrame(cv::Size size, int type)
+{
+    Frame frame = pool.acquire(size, type);
+    frame.timestamp = timestampNow();
+    frame.sequence = sequence++;
+    return frame;
+}
+
+
+// CAMERA SOURCE
+CameraSource::CameraSource(int index, cv::Size size, enum frame_format format)
+    : index(index),
+      format(format),
+      frame_size(size),
+      buffer_size(size),
+      buffer_type(CV_8UC3)
+{
+    {
+        std::lock_guard<std::mutex> lock(captureLock());
+        capture.open(index);
+    }
+    if (!capture.isOpened()) {
+        return;
+    }
+
+    capture.set(CV_CAP_PROP_FRAME_WIDTH, size.width);
+    capture.set(CV_CAP_PROP_FRAME_HEIGHT, size.height);
+    frame_size = cv::Size(
+        capture.get(CV_CAP_PROP_FRAME_WIDTH),
+        capture.get(CV_CAP_PROP_FRAME_HEIGHT)
+    );
+
+    // ask the driver for the native format and skip the BGR decode
+    if (format == FORMAT_YUYV) {
+        capture.set(CV_CAP_PROP_FOURCC, CV_FOURCC('Y', 'U', 'Y', 'V'));
+        capture.set(CV_CAP_PROP_CONVERT_RGB, 0);
+    } else if (format == FORMAT_NV12) {
+        capture.set(CV_CAP_PROP_FOURCC, CV_FOURCC('N', 'V', '1', '2'));
+        capture.set(CV_CAP_PROP_CONVERT_RGB, 0);
+    }
+}
+
+bool CameraSource::isOpened() const
+{
+    return capture.isOpened();
+}
+
+bool CameraSource::read(Frame &frame)
+{
+    // retrieve copies into the pooled buffer when the shape matches
+    frame = nextFrame(buffer_size, buffer_type);
+    if (!capture.read(frame.image) || frame.image.empty()) {
+        STATS_COUNT("read_failures", 1);
+        frame = Frame();
+        return false;
+    }
+
+    buffer_size = frame.image.size();
+    buffer_type = frame.image.type();
+    if (frame.image.type() == CV_8UC3) {
+        frame_size = frame.image.size();
+        return true;
+    }
+
+    return unpackNative(frame);
+}
+
+bool CameraSource::unpackNative(Frame &frame)
+{
+    size_t bytes = frame.image.total() * frame.image.elemSize();
+    size_t pixels = frame_size.area();
+
+    // backends hand out raw buffers either shaped or as a single row
+    if (format == FORMAT_YUYV && bytes == pixels * 2 && frame.image.isContinuous()) {
+        frame.image = frame.image.reshape(2, frame_size.height);
+        frame.format = FORMAT_YUYV;
+        return true;
+    } else if (format == FORMAT_NV12 && bytes == pixels * 3 / 2
+            && frame.image.isContinuous()) {
+        frame.image = frame.image.reshape(1, frame_size.height * 3 / 2);
+        frame.format = FORMAT_NV12;
+        return true;
+    } else if (frame.image.type() == CV_8UC1 && frame.image.size() == frame_size) {
+        frame.format = FORMAT_GRAY;
+        return true;
+    }
+
+    log_err(
+        "Unexpected %dx%d frame of type %d from camera %d!",
+        frame.image.cols,
+        frame.image.rows,
+        frame.image.type(),
+        index
+    );
+    STATS_COUNT("read_failures", 1);
+    frame = Frame();
+    return false;
+}
+
+cv::Size CameraSource::size() const
+{
+    return frame_size;
+}
+
+std::string CameraSource::name() const
+{
+    std::stringstream ss;
+    ss << "camera:" << index;
+    if (format != FORMAT_BGR) {
+        ss << ":" << frameFormatName(format);
+    }
+    return ss.str();
+}
+
+
+// VIDEO FILE SOURCE
+VideoFileSource::VideoFileSource(const std::string &path)
+    : path(path), frame_type(CV_8UC3)
+{
+    {
+        std::lock_guard<std::mutex> lock(captureLock());
+        capture.open(path);
+    }
+    if (capture.isOpened()) {
+        frame_size = cv::Size(
+            capture.get(CV_CAP_PROP_FRAME_WIDTH),
+            capture.get(CV_CAP_PROP_FRAME_HEIGHT)
+        );
+    }
+}
+
+bool VideoFileSource::isOpened() const
+{
+    return capture.isOpened();
+}
+
+bool VideoFileSource::read(Frame &frame)
+{
+    frame = nextFrame(frame_size, frame_type);
+    if (!capture.read(frame.image) || frame.image.empty()) {
+        frame = Frame();
+        return false;
+    }
+
+    frame_size = frame.image.size();
+    frame_type = frame.image.type();
+    return true;
+}
+
+cv::Size VideoFileSource::size() const
+{
+    return frame_size;
+}
+
+std::string VideoFileSource::name() const
+{
+    return "file:" + path;
+}
+
+
+// RAW VIDEO SOURCE
+RawVideoSource::RawVideoSource(
+    const std::string &path,
+    cv::Size size,
+    enum frame_format format)
+    : path(path),
+      frame_size(size),
+      format(format),
+      frame_bytes(0),
+      num_frames(0),
+      index(0)
+{
+    struct stat st;
+    void *data;
+    int fd;
+
+    switch (format) {
+    case FORMAT_BGR: frame_bytes = size.area() * 3; break;
+    case FORMAT_GRAY: frame_bytes = size.area(); break;
+    case FORMAT_YUYV: frame_bytes = size.area() * 2; break;
+    case FORMAT_NV12: frame_bytes = size.area() * 3 / 2; break;
+    }
+    if (frame_bytes == 0) {
+        log_err("Invalid raw video size %dx%d!", size.width, size.height);
+        return;
+    }
+
+    // map file
+    fd = open(path.c_str(), O_RDONLY);
+    if (fd == -1) {
+        log_err("Failed to open raw video [%s]!", path.c_str());
+        return;
+    }
+    if (fstat(fd, &st) == -1 || (size_t) st.st_size < frame_bytes) {
+        log_err("Raw video [%s] holds no complete frame!", path.c_str());
+        close(fd);
+        return;
+    }
+
+    // private writable mapping, so consumers may draw on frames
+    data = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        log_err("Failed to mmap raw video [%s]!", path.c_str());
+        return;
+    }
+
+    size_t mapping_size = st.st_size;
+    mapping = std::shared_ptr<char>(
+        (char *) data,
+        [mapping_size](char *p) { munmap(p, mapping_size); }
+    );
+    num_frames = mapping_size / frame_bytes;
+}
+
+bool RawVideoSource::isOpened() const
+{
+    return num_frames > 0;
+}
+
+bool RawVideoSource::read(Frame &frame)
+{
+    char *data;
+
+    if (index >= num_frames) {
+        frame = Frame();
+        return false;
+    }
+    data = mapping.get() + index++ * frame_bytes;
+
+    frame = Frame();
+    switch (format) {
+    case FORMAT_BGR:
+        frame.image = cv::Mat(frame_size, CV_8UC3, data);
+        break;
+    case FORMAT_GRAY:
+        frame.image = cv::Mat(frame_size, CV_8UC1, data);
+        break;
+    case FORMAT_YUYV:
+        frame.image = cv::Mat(frame_size, CV_8UC2, data);
+        break;
+    case FORMAT_NV12:
+        frame.image = cv::Mat(frame_size.height * 3 / 2, frame_size.width, CV_8UC1, data);
+        break;
+    }
+    frame.format = format;
+    frame.timestamp = timestampNow();
+    frame.sequence = sequence++;
+    frame.buffer = mapping;
+    return true;
+}
+
+cv::Size RawVideoSource::size() const
+{
+    return frame_size;
+}
+
+std::string RawVideoSource::name() const
+{
+    std::stringstream ss;
+    ss << "raw:" << path << ":" << frame_size.width << "x" << frame_size.height;
+    ss << ":" << frameFormatName(format);
+    return ss.str();
+}
+
+
+// IMAGE SEQUENCE SOURCE
+// the pattern is handed to snprintf, so it must hold exactly one integer
+// conversion with optional zero padding and width, e.g. img_%04d.png, and
+// no other %
+static bool isSequencePattern(const std::string &pattern)
+{
+    size_t conversion = pattern.find('%');
+    size_t i;
+
+    if (conversion == std::string::npos
+            || pattern.find('%', conversion + 1) != std::string::npos) {
+        return false;
+    }
+
+    i = conversion + 1;
+    while (i < pattern.size() && isdigit((unsigned char) pattern[i])) {
+        i++;
+    }
+
+    return i < pattern.size() && pattern[i] == 'd';
+}
+
+ImageSequenceSource::ImageSequenceSource(const std::string &pattern, int start)
+    : pattern(pattern), valid(isSequencePattern(pattern)), index(start)
+{
+    if (!valid) {
+        log_err(
+            "Invalid image sequence pattern [%s], expected a single %%d!",
+            pattern.c_str()
+        );
+        return;
+    }
+
+    cv::Mat first = cv::imread(imagePath(index));
+    frame_size = first.size();
+}
+
+std::string ImageSequenceSource::imagePath(int i) const
+{
+    char path[1024];
+    snprintf(path, sizeof(path), pattern.c_str(), i);
+    return path;
+}
+
+bool ImageSequenceSource::isOpened() const
+{
+    return frame_size.area() > 0;
+}
+
+bool ImageSequenceSource::read(Frame &frame)
+{
+    // imread always allocates, copy into a pooled buffer so consumers see
+    // the same buffer life cycle as every other source
+    cv::Mat image;
+    if (valid) {
+        image = cv::imread(imagePath(index));
+    }
+    if (image.empty()) {
+        frame = Frame();
+        return false;
+    }
+    index++;
+
+    frame = nextFrame(image.size(), image.type());
+    image.copyTo(frame.image);
+    frame_size = image.size();
+    return true;
+}
+
+cv::Size ImageSequenceSource::size() const
+{
+    return frame_size;
+}
+
+std::string ImageSequenceSource::name() const
+{
+    return "images:" + pattern;
+}
+
+
+// SYNTHETIC SOURCE
+SyntheticSource::SyntheticSource(cv::Size size, int shift)
+    : frame_size(size), shift(shift)
+{
+    cv::RNG rng(0xe7e5);
+    cv::Mat noise(size.height / 4 + 1, (size.width + shift) / 4 + 1, CV_8UC3);
+
+    // coarse random texture so block matching has something to lock on to
+    rng.fill(noise, cv::RNG::UNIFORM, cv::Scalar::all(40), cv::Scalar::all(160));
+    cv::resize(
+        noise,
+        background,
+        cv::Size(size.width + shift, size.height),
+        0,
+        0,
+        cv::INTER_NEAREST
+    );
+}
+
+bool SyntheticSource::isOpened() const
+{
+    return frame_size.area() > 0;
+}
+
+bool SyntheticSource::read(Frame &frame)
+{
+    double t;
+    cv::Point centre;
+    int radius = std::max(4, std::min(frame_size.width, frame_size.height) / 12);
+
+    frame = nextFrame(frame_size, CV_8UC3);
+    t = frame.sequence * 0.05;
+
+    // shifted view of the texture, then the ball
+    background(cv::Rect(shift, 0, frame_size.width, frame_size.height))
+        .copyTo(frame.image);
+    centre = cv::Point(
+        frame_size.width / 2 + cos(t) * frame_size.width / 3 - shift,
+        frame_size.height / 2 + sin(t) * frame_size.height / 3
+    );
+    cv::circle(frame.image, centre, radius, cv::Scalar(40, 60, 220), -1);
+
+    return true;
+}
+
+cv::Size SyntheticSource::size() const
+{
+    return frame_size;
+}
+
+std::string SyntheticSource::name() const
+{
+    std::stringstream ss;
+    ss << "synthetic:" << frame_size.width << "x" << frame_size.height;
+    ss << ":" << shift;
+    return ss.str();
+}
+
+
+// FACTORY
+static FrameSource *openReplaySource(const std::string &arg)
+{
+    std::string path = arg;
+    size_t split = path.rfind(':');
+    bool realtime = true;
+    int stream = 0;
+
+    // <path>[:<stream>[:fast]]
+    if (split != std::string::npos && path.substr(split + 1) == "fast") {
+        realtime = false;
+        path = path.substr(0, split);
+        split = path.rfind(':');
+    }
+    if (split != std::string::npos
+            && split + 1 < path.size()
+            && path.find_first_not_of("0123456789", split + 1) == std::string::npos) {
+        stream = atoi(path.c_str() + split + 1);
+        path = path.substr(0, split);
+    }
+
+    return new ReplaySource(path, stream, realtime);
+}
+
+static FrameSource *openCameraSource(const std::string &arg, cv::Size size)
+{
+    enum frame_format format = FORMAT_BGR;
+    size_t split = arg.find(':');
+
+    // <index>[:<format>]
+    if (split != std::string::npos
+            && !parseFrameFormat(arg.substr(split + 1), format)) {
+        log_err("Unknown camera format [%s]!", arg.substr(split + 1).c_str());
+        return NULL;
+    }
+
+    return new CameraSource(atoi(arg.c_str()), size, format);
+}
+
+static FrameSource *openRawVideoSource(const std::string &arg)
+{
+    enum frame_format format = FORMAT_YUYV;
+    size_t format_split = arg.rfind(':');
+    size_t size_split;
+    int width = 0;
+    int height = 0;
+
+    // <path>:<W>x<H>:<format>
+    if (format_split == std::string::npos
+            || (size_split = arg.rfind(':', format_split - 1)) == std::string::npos
+            || sscanf(arg.c_str() + size_split + 1, "%dx%d", &width, &height) != 2
+            || !parseFrameFormat(arg.substr(format_split + 1), format)) {
+        log_err("Invalid raw video spec [%s], expected <path>:<W>x<H>:<format>!", arg.c_str());
+        return NULL;
+    }
+
+    return new RawVideoSource(arg.substr(0, size_split), cv::Size(width, height), format);
+}
+
+cv::Ptr<FrameSource> openFrameSource(const std::string &spec, cv::Size size)
+{
+    cv::Ptr<FrameSource> source;
+    size_t split = spec.find(':');
+    std::string type = spec.substr(0, split);
+    std::string arg = (split == std::string::npos) ? "" : spec.substr(split + 1);
+
+    if (type == "camera") {
+        source = openCameraSource(arg, size);
+    } else if (type == "file") {
+        source = new VideoFileSource(arg);
+    } else if (type == "raw") {
+        source = openRawVideoSource(arg);
+    } else if (type == "images") {
+        source = new ImageSequenceSource(arg);
+    } else if (type == "replay") {
+        source = openReplaySource(arg);
+    } else if (type == "synthetic") {
+        int width = size.width;
+        int height = size.height;
+        int shift = 0;
+
+        sscanf(arg.c_str(), "%dx%d:%d", &width, &height, &shift);
+        source = new SyntheticSource(cv::Size(width, height), shift);
+    } else if (spec.find_first_not_of("0123456789") == std::string::npos) {
+        source = new CameraSource(atoi(spec.c_str()), size);
+    } else if (spec.find('%') != std::string::npos) {
+        source = new ImageSequenceSource(spec);
+    } else {
+        source = new VideoFileSource(spec);
+    }
+
+    if (source.empty() || !source->isOpened()) {
+        log_err("Failed to open frame source [%s]!", spec.c_str());
+        return cv::Ptr<FrameSource>();
+    }
+
+    return source;
+}
+
+bool parseFrameFormat(const std::string &name, enum frame_format &format)
+{
+    if (name == "bgr") {
+        format = FORMAT_BGR;
+    } else if (name == "gray") {
+        format = FORMAT_GRAY;
+    } else if (name == "yuyv") {
+        format = FORMAT_YUYV;
+    } else if (name == "nv12") {
+        format = FORMAT_NV12;
+    } else {
+        return false;
+    }
+
+    return true;
+}
+
+const char *frameFormatName(enum frame_format format)
+{
+    switch (format) {
+    case FORMAT_BGR: return "bgr";
+    case FORMAT_GRAY: return "gray";
+    case FORMAT_YUYV: return "yuyv";
+    case FORMAT_NV12: return "nv12";
+    }
+
+    return "unknown";
+}
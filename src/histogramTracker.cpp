@@ -0,0 +1,317 @@
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+
+#include <opencv2/core/core.hpp>
+#include <opencv2/imgproc/imgproc.hpp>
+
+#include <eyes/histogramTracker.hpp>
+#include <eyes/stats.hpp>
+
+// CamShift measures the size of the object on a slightly larger window
+#define CAMSHIFT_TOLERANCE 10
+
+#define SUM_CHANNELS 6
+
+HistogramTracker::HistogramTracker()
+    : learned(false),
+      lost(false),
+      lut(HISTOGRAM_H_BINS * HISTOGRAM_S_BINS, 0)
+{
+    // quantize once, so back projection is two lookups per pixel
+    for (int i = 0; i < 256; i++) {
+        h_index[i] = std::min(i * HISTOGRAM_H_BINS / 180, HISTOGRAM_H_BINS - 1)
+            * HISTOGRAM_S_BINS;
+        s_index[i] = i * HISTOGRAM_S_BINS / 256;
+    }
+}
+
+void HistogramTracker::learn(const cv::Mat &frame, cv::Rect roi)
+{
+    std::vector<int> histogram(lut.size(), 0);
+    int peak = 0;
+
+    roi &= cv::Rect(0, 0, frame.cols, frame.rows);
+    if (roi.area() == 0) {
+        return;
+    }
+    cv::cvtColor(frame(roi), hsv, cv::COLOR_BGR2HSV);
+
+    for (int y = 0; y < hsv.rows; y++) {
+        const uchar *p = hsv.ptr<uchar>(y);
+
+        for (int x = 0; x < hsv.cols; x++, p += 3) {
+            if (p[1] >= HISTOGRAM_MIN_SATURATION && p[2] >= HISTOGRAM_MIN_VALUE) {
+                int bin = h_index[p[0]] + s_index[p[1]];
+                peak = std::max(peak, ++histogram[bin]);
+            }
+        }
+    }
+
+    // scale the most frequent colour to a probability of 255
+    for (size_t i = 0; i < lut.size(); i++) {
+        lut[i] = peak ? histogram[i] * 255 / peak : 0;
+    }
+
+    track_window = roi;
+    track_box = cv::RotatedRect(
+        cv::Point2f(roi.x + roi.width / 2.0f, roi.y + roi.height / 2.0f),
+        cv::Size2f(roi.width, roi.height),
+        0
+    );
+    learned = true;
+    lost = false;
+}
+
+uchar HistogramTracker::probability(const uchar *p) const
+{
+    if (p[1] < HISTOGRAM_MIN_SATURATION || p[2] < HISTOGRAM_MIN_VALUE) {
+        return 0;
+    }
+    return lut[h_index[p[0]] + s_index[p[1]]];
+}
+
+bool HistogramTracker::reacquire(const cv::Mat &frame)
+{
+    cv::Rect bounds(0, 0, frame.cols, frame.rows);
+    cv::Size small_size(
+        std::max(frame.cols / CAMSHIFT_REACQUIRE_SCALE, 1),
+        std::max(frame.rows / CAMSHIFT_REACQUIRE_SCALE, 1)
+    );
+    double scale_x = (double) frame.cols / small_size.width;
+    double scale_y = (double) frame.rows / small_size.height;
+    cv::Size window(
+        std::min(std::max(cvRound(track_window.width / scale_x), 1), small_size.width),
+        std::min(std::max(cvRound(track_window.height / scale_y), 1), small_size.height)
+    );
+    cv::Point peak;
+    double mass;
+    STATS_SCOPE("camshift_reacquire");
+
+    search = bounds;
+    cv::resize(frame, scaled, small_size, 0, 0, cv::INTER_AREA);
+    cv::cvtColor(scaled, hsv, cv::COLOR_BGR2HSV);
+    back_projection.create(small_size, CV_8UC1);
+    for (int y = 0; y < hsv.rows; y++) {
+        const uchar *p = hsv.ptr<uchar>(y);
+        uchar *bp = back_projection.ptr<uchar>(y);
+
+        for (int x = 0; x < hsv.cols; x++, p += 3) {
+            bp[x] = probability(p);
+        }
+    }
+
+    // the densest window of the object's last size, sums are unnormalized
+    // and a downscaled pixel stands for scale_x * scale_y full pixels
+    cv::boxFilter(
+        back_projection,
+        density,
+        CV_32F,
+        window,
+        cv::Point(-1, -1),
+        false,
+        cv::BORDER_CONSTANT
+    );
+    cv::minMaxLoc(density, NULL, &mass, NULL, &peak);
+    if (mass * scale_x * scale_y < CAMSHIFT_MIN_MASS * 255) {
+        return false;
+    }
+
+    track_window = cv::Rect(
+        cvRound((peak.x - window.width / 2) * scale_x),
+        cvRound((peak.y - window.height / 2) * scale_y),
+        track_window.width,
+        track_window.height
+    ) & bounds;
+
+    return track_window.area() > 0;
+}
+
+void HistogramTracker::backProject(const cv::Mat &frame)
+{
+    STATS_SCOPE("back_projection");
+
+    cv::cvtColor(frame(search), hsv, cv::COLOR_BGR2HSV);
+    back_projection.create(search.size(), CV_8UC1);
+    sums.create(search.height + 1, search.width + 1, CV_64FC(SUM_CHANNELS));
+    memset(sums.ptr<double>(0), 0, sums.cols * sums.elemSize());
+
+    // back project and integrate in the same pass, coordinates are relative
+    // to the search area
+    for (int y = 0; y < search.height; y++) {
+        const uchar *p = hsv.ptr<uchar>(y);
+        uchar *bp = back_projection.ptr<uchar>(y);
+        const double *above = sums.ptr<double>(y);
+        double *sum = sums.ptr<double>(y + 1);
+        double row[SUM_CHANNELS] = {0, 0, 0, 0, 0, 0};
+
+        for (int c = 0; c < SUM_CHANNELS; c++) {
+            sum[c] = 0;
+        }
+        above += SUM_CHANNELS;
+        sum += SUM_CHANNELS;
+
+        for (int x = 0; x < search.width; x++, p += 3) {
+            int prob = probability(p);
+
+            bp[x] = prob;
+
+            row[0] += prob;
+            row[1] += (double) x * prob;
+            row[2] += (double) y * prob;
+            row[3] += (double) x * x * prob;
+            row[4] += (double) y * y * prob;
+            row[5] += (double) x * y * prob;
+            for (int c = 0; c < SUM_CHANNELS; c++) {
+                sum[c] = above[c] + row[c];
+            }
+            above += SUM_CHANNELS;
+            sum += SUM_CHANNELS;
+        }
+    }
+}
+
+struct HistogramTracker::window_moments HistogramTracker::moments(cv::Rect r) const
+{
+    const double *tl = sums.ptr<double>(r.y) + r.x * SUM_CHANNELS;
+    const double *tr = sums.ptr<double>(r.y) + (r.x + r.width) * SUM_CHANNELS;
+    const double *bl = sums.ptr<double>(r.y + r.height) + r.x * SUM_CHANNELS;
+    const double *br = sums.ptr<double>(r.y + r.height) + (r.x + r.width) * SUM_CHANNELS;
+    double m[SUM_CHANNELS];
+    struct window_moments result;
+
+    for (int c = 0; c < SUM_CHANNELS; c++) {
+        m[c] = br[c] - bl[c] - tr[c] + tl[c];
+    }
+    result.m00 = m[0];
+    result.m10 = m[1];
+    result.m01 = m[2];
+    result.m20 = m[3];
+    result.m02 = m[4];
+    result.m11 = m[5];
+
+    return result;
+}
+
+bool HistogramTracker::track(const cv::Mat &frame)
+{
+    cv::Rect bounds(0, 0, frame.cols, frame.rows);
+    struct window_moments m;
+    cv::Rect w;
+    STATS_SCOPE("camshift");
+
+    if (!learned) {
+        return false;
+    }
+
+    // once lost, find the object on a downscaled frame first
+    if ((lost || (track_window & bounds).area() == 0) && !reacquire(frame)) {
+        lost = true;
+        return false;
+    }
+
+    // search around the last window
+    search = cv::Rect(
+        track_window.x - track_window.width,
+        track_window.y - track_window.height,
+        track_window.width * 3,
+        track_window.height * 3
+    ) & bounds;
+    backProject(frame);
+
+    // mean shift, in search area coordinates
+    w = (track_window - search.tl()) & cv::Rect(0, 0, search.width, search.height);
+    for (int i = 0; i < CAMSHIFT_MAX_ITERATIONS; i++) {
+        int dx;
+        int dy;
+
+        m = moments(w);
+        if (m.m00 < CAMSHIFT_MIN_MASS * 255) {
+            lost = true;
+            return false;
+        }
+
+        dx = cvRound(m.m10 / m.m00 - (w.x + w.width * 0.5));
+        dy = cvRound(m.m01 / m.m00 - (w.y + w.height * 0.5));
+        w.x = std::min(std::max(w.x + dx, 0), search.width - w.width);
+        w.y = std::min(std::max(w.y + dy, 0), search.height - w.height);
+        if (dx == 0 && dy == 0) {
+            break;
+        }
+    }
+
+    // CamShift, size and orientation from the second moments
+    w = cv::Rect(
+        w.x - CAMSHIFT_TOLERANCE,
+        w.y - CAMSHIFT_TOLERANCE,
+        w.width + 2 * CAMSHIFT_TOLERANCE,
+        w.height + 2 * CAMSHIFT_TOLERANCE
+    ) & cv::Rect(0, 0, search.width, search.height);
+    m = moments(w);
+    if (m.m00 < CAMSHIFT_MIN_MASS * 255) {
+        lost = true;
+        return false;
+    }
+
+    double xc = m.m10 / m.m00;
+    double yc = m.m01 / m.m00;
+    double a = m.m20 / m.m00 - xc * xc;
+    double b = m.m11 / m.m00 - xc * yc;
+    double c = m.m02 / m.m00 - yc * yc;
+    double square = sqrt(4 * b * b + (a - c) * (a - c));
+    double theta = atan2(2 * b, a - c + square);
+    double cs = cos(theta);
+    double sn = sin(theta);
+    double length = 4 * sqrt(std::max(cs * cs * a + 2 * cs * sn * b + sn * sn * c, 0.0));
+    double width = 4 * sqrt(std::max(sn * sn * a - 2 * cs * sn * b + cs * cs * c, 0.0));
+
+    track_box = cv::RotatedRect(
+        cv::Point2f(search.x + xc, search.y + yc),
+        cv::Size2f(length, width),
+        theta * 180 / CV_PI
+    );
+
+    // next window covers the box, but never collapses
+    track_window = track_box.boundingRect() & bounds;
+    if (track_window.width < CAMSHIFT_MIN_SIZE || track_window.height < CAMSHIFT_MIN_SIZE) {
+        track_window = cv::Rect(
+            cvRound(search.x + xc) - CAMSHIFT_MIN_SIZE / 2,
+            cvRound(search.y + yc) - CAMSHIFT_MIN_SIZE / 2,
+            CAMSHIFT_MIN_SIZE,
+            CAMSHIFT_MIN_SIZE
+        ) & bounds;
+    }
+    lost = false;
+
+    return true;
+}
+
+bool HistogramTracker::isLearned() const
+{
+    return learned;
+}
+
+bool HistogramTracker::isLost() const
+{
+    return lost;
+}
+
+cv::RotatedRect HistogramTracker::box() const
+{
+    return track_box;
+}
+
+cv::Rect HistogramTracker::window() const
+{
+    return track_window;
+}
+
+cv::Rect HistogramTracker::searchArea() const
+{
+    return search;
+}
+
+const cv::Mat &HistogramTracker::backProjection() const
+{
+    return back_projection;
+}
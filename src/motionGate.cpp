@@ -0,0 +1,167 @@
+#include <algorithm>
+
+#include <opencv2/core/core.hpp>
+#include <opencv2/imgproc/imgproc.hpp>
+
+#include <eyes/motionGate.hpp>
+#include <eyes/stats.hpp>
+
+static cv::Rect gridCell(cv::Size size, cv::Size grid, int col, int row)
+{
+    int x0 = col * size.width / grid.width;
+    int x1 = (col + 1) * size.width / grid.width;
+    int y0 = row * size.height / grid.height;
+    int y1 = (row + 1) * size.height / grid.height;
+
+    return cv::Rect(x0, y0, x1 - x0, y1 - y0);
+}
+
+static cv::Rect grow(cv::Rect r, int margin)
+{
+    return cv::Rect(
+        r.x - margin,
+        r.y - margin,
+        r.width + 2 * margin,
+        r.height + 2 * margin
+    );
+}
+
+MotionGate::MotionGate(cv::Size grid, int threshold)
+    : grid(grid), threshold(threshold), valid(false), changed_tiles(0)
+{
+    tiles = cv::Mat::zeros(grid, CV_8U);
+}
+
+int MotionGate::update(const cv::Mat &frame)
+{
+    cv::Size small_size(
+        std::max(frame.cols / MOTION_SCALE, grid.width),
+        std::max(frame.rows / MOTION_SCALE, grid.height)
+    );
+    STATS_SCOPE("motion_gate");
+
+    // downscale before the grey conversion, it is the cheaper order
+    if (frame.channels() == 3) {
+        cv::resize(frame, scaled, small_size, 0, 0, cv::INTER_AREA);
+        cv::cvtColor(scaled, small, CV_BGR2GRAY);
+    } else {
+        cv::resize(frame, small, small_size, 0, 0, cv::INTER_AREA);
+    }
+
+    // first frame, new size or invalidated: everything is stale
+    if (!valid || frame.size() != frame_size) {
+        frame_size = frame.size();
+        small.copyTo(reference);
+        tiles.setTo(1);
+        changed_tiles = numTiles();
+        valid = true;
+        STATS_COUNT("motion_tiles_changed", changed_tiles);
+        return changed_tiles;
+    }
+
+    cv::absdiff(small, reference, diff);
+    cv::threshold(diff, diff, threshold, 255, cv::THRESH_BINARY);
+
+    changed_tiles = 0;
+    for (int row = 0; row < grid.height; row++) {
+        for (int col = 0; col < grid.width; col++) {
+            cv::Rect cell = smallTileRect(col, row);
+            bool changed = cv::countNonZero(diff(cell)) > 0;
+
+            tiles.at<uchar>(row, col) = changed;
+            if (changed) {
+                small(cell).copyTo(reference(cell));
+                changed_tiles++;
+            }
+        }
+    }
+    STATS_COUNT("motion_tiles_changed", changed_tiles);
+
+    return changed_tiles;
+}
+
+void MotionGate::invalidate()
+{
+    valid = false;
+}
+
+cv::Size MotionGate::gridSize() const
+{
+    return grid;
+}
+
+int MotionGate::numTiles() const
+{
+    return grid.area();
+}
+
+int MotionGate::changedTiles() const
+{
+    return changed_tiles;
+}
+
+bool MotionGate::tileChanged(int col, int row) const
+{
+    return tiles.at<uchar>(row, col) != 0;
+}
+
+bool MotionGate::rowChanged(int row) const
+{
+    return cv::countNonZero(tiles.row(row)) > 0;
+}
+
+cv::Rect MotionGate::tileRect(int col, int row) const
+{
+    return gridCell(frame_size, grid, col, row);
+}
+
+cv::Rect MotionGate::smallTileRect(int col, int row) const
+{
+    return gridCell(small.size(), grid, col, row);
+}
+
+std::vector<cv::Rect> MotionGate::changedRegions(int margin) const
+{
+    std::vector<cv::Rect> regions;
+    cv::Rect frame(0, 0, frame_size.width, frame_size.height);
+    bool merged = true;
+
+    // tiles map back onto the frame to within a downscaled pixel
+    margin += MOTION_SCALE;
+
+    // runs of changed tiles along each row
+    for (int row = 0; row < grid.height; row++) {
+        for (int col = 0; col < grid.width; col++) {
+            int end = col;
+
+            if (!tileChanged(col, row)) {
+                continue;
+            }
+            while (end + 1 < grid.width && tileChanged(end + 1, row)) {
+                end++;
+            }
+
+            regions.push_back(
+                grow(tileRect(col, row) | tileRect(end, row), margin) & frame
+            );
+            col = end;
+        }
+    }
+
+    // merge overlapping regions so no pixel is processed twice
+    while (merged) {
+        merged = false;
+        for (size_t i = 0; i < regions.size() && !merged; i++) {
+            for (size_t j = i + 1; j < regions.size(); j++) {
+                if ((regions[i] & regions[j]).area() > 0) {
+                    regions[i] = regions[i] | regions[j];
+                    regions.erase(regions.begin() + j);
+                    merged = true;
+                    break;
+                }
+            }
+        }
+    }
+
+    return regions;
+}
@@ -1,9 +1,21 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
 #include <sstream>
 #include <string>
 #include <iostream>
 #include <opencv/highgui.h>
 #include <opencv/cv.h>
 
+#include <eyes/frameSource.hpp>
+#include <eyes/histogramTracker.hpp>
+#include <eyes/motionGate.hpp>
+#include <eyes/pixelFormat.hpp>
+#include <eyes/recording.hpp>
+#include <eyes/stats.hpp>
+#include <eyes/tracking.hpp>
+#include <eyes/videoRecorder.hpp>
+
 using namespace cv;
 
 // initial default min and max HSV filter values
@@ -17,9 +29,7 @@ int V_MAX = 256;
 // program defaults
 const int FRAME_WIDTH = 400;
 const int FRAME_HEIGHT = 300;
-const int MAX_NUM_OBJECTS=50;
-const int MIN_OBJECT_AREA = 20*20;
-const int MAX_OBJECT_AREA = FRAME_HEIGHT*FRAME_WIDTH / 1.5;
+const double OUTPUT_FPS = 30.0;
 
 // gui window titles
 const string windowName = "Original Image";
@@ -28,14 +38,34 @@ const string windowName2 = "Thresholded Image";
 const string windowName3 = "After Morphological Operations";
 const string trackbarWindowName = "Trackbars";
 
-void on_trackbar(int, void*) {
-    // gets called whenever a trackbar position is changed
+// object selection for the CamShift mode, dragged out with the mouse
+Rect selection;
+Point selectionOrigin;
+bool selecting = false;
+bool selected = false;
+
+void on_mouse(int event, int x, int y, int, void*) {
+	if (selecting) {
+		selection = Rect(
+			std::min(x, selectionOrigin.x),
+			std::min(y, selectionOrigin.y),
+			abs(x - selectionOrigin.x),
+			abs(y - selectionOrigin.y)
+		);
+	}
+
+	if (event == CV_EVENT_LBUTTONDOWN) {
+		selectionOrigin = Point(x, y);
+		selection = Rect(x, y, 0, 0);
+		selecting = true;
+	} else if (event == CV_EVENT_LBUTTONUP) {
+		selecting = false;
+		selected = selection.area() > 0;
+	}
 }
 
-string intToString(int number) {
-	std::stringstream ss;
-	ss << number;
-	return ss.str();
+void on_trackbar(int, void*) {
+    // gets called whenever a trackbar position is changed
 }
 
 void createTrackbars() {
@@ -64,97 +94,89 @@ void createTrackbars() {
 	createTrackbar("V_MAX", trackbarWindowName, &V_MAX, V_MAX, on_trackbar);
 }
 
-void drawObject(int x, int y,Mat &frame){
-	// draw crossairs on tracked objects
-	circle(frame,Point(x, y),20,Scalar(0,255,0),2);
-	line(frame,Point(x, y - 5), Point(x, y - 25), Scalar(0, 255, 0), 2);
-	line(frame,Point(x, y + 5), Point(x, y + 25), Scalar(0, 255, 0), 2);
-	line(frame,Point(x - 5, y), Point(x - 25, y), Scalar(0, 255, 0), 2);
-	line(frame,Point(x + 5, y), Point(x + 25, y), Scalar(0, 255, 0), 2);
-
-	putText(
-		frame,
-		intToString(x) + "," + intToString(y),
-		Point(x, y + 30),
-		1,
-		1,
-		Scalar(0, 255, 0),
-        2
+int trackPyramidObjects(
+	Mat &cameraFeed,
+	Mat &threshold,
+	bool useMorphOps,
+	vector<struct tracked_object> &objects)
+{
+	return trackPyramid(
+		cameraFeed,
+		Scalar(H_MIN, S_MIN, V_MIN),
+		Scalar(H_MAX, S_MAX, V_MAX),
+		useMorphOps,
+		objects,
+		&threshold
 	);
 }
 
-void morphOps(Mat &thresh){
-	//create structuring element that will be used to "dilate" and "erode" image.
-	//the element chosen here is a 3px by 3px rectangle
-    Mat erodeElement = getStructuringElement(MORPH_RECT, Size(3, 3));
+void drawPyramidObjects(
+	int found,
+	const vector<struct tracked_object> &objects,
+	Mat &cameraFeed)
+{
+	size_t largest = 0;
 
-    //dilate with larger element so make sure object is nicely visible
-    Mat dilateElement = getStructuringElement(MORPH_RECT, Size(8, 8));
+	if (found < 0) {
+		putText(cameraFeed,
+			"TOO MUCH NOISE! ADJUST FILTER",
+			Point(0,50),
+			1,
+			2,
+			Scalar(0,0,255),
+			2
+		);
+		return;
+	} else if (found == 0) {
+		return;
+	}
 
-	erode(thresh, thresh,erodeElement);
-	erode(thresh, thresh,erodeElement);
+	// follow the largest object, same as trackFilteredObject
+	for (size_t i = 1; i < objects.size(); i++) {
+		if (objects[i].area > objects[largest].area)
+			largest = i;
+	}
 
-	dilate(thresh, thresh,dilateElement);
-	dilate(thresh, thresh,dilateElement);
+	putText(cameraFeed, "Tracking Object", Point(0, 50), 2, 1, Scalar(0, 255, 0), 2);
+	drawObject(objects[largest].centre.x, objects[largest].centre.y, cameraFeed);
 }
 
-void trackFilteredObject(int &x, int &y, Mat threshold, Mat &cameraFeed) {
-	Mat temp;
-	vector<vector<Point> > contours;
-	vector<Vec4i> hierarchy;
-	double refArea = 0;
-	bool objectFound = false;
-
-	threshold.copyTo(temp);
-
-	// these two vectors needed for output of findContours
-	// find contours of filtered image using openCV findContours function
-	findContours(temp, contours, hierarchy, CV_RETR_CCOMP, CV_CHAIN_APPROX_SIMPLE);
-	// use moments method to find our filtered object
-	if (hierarchy.size() > 0) {
-		int numObjects = hierarchy.size();
-
-		//if number of objects greater than MAX_NUM_OBJECTS we have a noisy filter
-		if (numObjects<MAX_NUM_OBJECTS) {
-			for (int index = 0; index >= 0; index = hierarchy[index][0]) {
-				Moments moment = moments((cv::Mat)contours[index]);
-				double area = moment.m00;
-
-				// if the area is less than 20 px by 20px then it is probably just noise
-				// if the area is the same as the 3/2 of the image size, probably just a bad filter
-				// we only want the object with the largest area so we safe a reference area each
-				// iteration and compare it to the area in the next iteration.
-				if (area>MIN_OBJECT_AREA && area<MAX_OBJECT_AREA && area>refArea) {
-					x = moment.m10 / area;
-					y = moment.m01 / area;
-					objectFound = true;
-				} else {
-					objectFound = false;
-				}
-			}
-			//let user know you found an object
-			if (objectFound == true) {
-				putText(cameraFeed,
-					"Tracking Object",
-					Point(0, 50),
-					2,
-					1,
-					Scalar(0, 255, 0),
-					2
-				);
-				drawObject(x, y, cameraFeed);
-			}
-		} else {
-			putText(cameraFeed,
-                "TOO MUCH NOISE! ADJUST FILTER",
-                Point(0,50),
-                1,
-                2,
-                Scalar(0,0,255),
-                2
-			);
-		}
+void trackCamShift(HistogramTracker &tracker, Mat &cameraFeed, Mat &threshold) {
+	// learn the object once a selection is made
+	if (selected) {
+		tracker.learn(cameraFeed, selection);
+		selected = false;
+	}
+	if (!tracker.isLearned()) {
+		putText(cameraFeed, "SELECT OBJECT", Point(0, 50), 1, 2, Scalar(0, 0, 255), 2);
+		if (selecting)
+			rectangle(cameraFeed, selection, Scalar(0, 255, 0), 1);
+		return;
+	}
+
+	if (tracker.track(cameraFeed)) {
+		RotatedRect box = tracker.box();
+
+		putText(cameraFeed, "Tracking Object", Point(0, 50), 2, 1, Scalar(0, 255, 0), 2);
+		ellipse(cameraFeed, box, Scalar(0, 255, 0), 2);
+		drawObject(box.center.x, box.center.y, cameraFeed);
+	} else {
+		putText(cameraFeed, "OBJECT LOST", Point(0, 50), 1, 2, Scalar(0, 0, 255), 2);
 	}
+	threshold = tracker.backProjection();
+}
+
+// cached results are stale once the filter settings change
+bool filterChanged(Scalar &hsvMin, Scalar &hsvMax) {
+	Scalar currentMin(H_MIN, S_MIN, V_MIN);
+	Scalar currentMax(H_MAX, S_MAX, V_MAX);
+
+	if (currentMin == hsvMin && currentMax == hsvMax)
+		return false;
+
+	hsvMin = currentMin;
+	hsvMax = currentMax;
+	return true;
 }
 
 int main(int argc, char* argv[])
@@ -163,47 +185,239 @@ int main(int argc, char* argv[])
 	int y = 0;
 	bool trackObjects = true;
 	bool useMorphOps = false;
+	bool usePyramid = false;
+	bool useMotionGate = false;
+	bool useCamShift = false;
+	bool headless = false;
+	bool needFeed = true;
+	HistogramTracker tracker;
+	int trackingStatus = TRACKING_NONE;
+	int pyramidFound = 0;
+	int changedTiles = 0;
+	vector<struct tracked_object> pyramidObjects;
+	MotionGate gate;
+	Scalar hsvMin;
+	Scalar hsvMax;
+	int frameWidth = FRAME_WIDTH;
+	int frameHeight = FRAME_HEIGHT;
+	string sourceSpec = "camera:0";
+	string recordPath;
+	string annotatedPath;
+	string dropPolicy = "oldest";
+	Ptr<VideoRecorder> annotated;
+	Frame frame;
 	Mat cameraFeed;
+	Mat gray;
 	Mat HSV;
 	Mat threshold;
-	VideoCapture capture;
+	Ptr<FrameSource> source;
 
-	//create slider bars for HSV filtering and open video capture
-	createTrackbars();
-	capture.open(0);
+	// parse arguments
+	for (int i = 1; i < argc; i++) {
+		if (string(argv[i]) == "--source" && i + 1 < argc) {
+			sourceSpec = argv[++i];
+		} else if (string(argv[i]) == "--stats" && i + 1 < argc) {
+			statsStart(argv[++i]);
+		} else if (string(argv[i]) == "--width" && i + 1 < argc) {
+			frameWidth = atoi(argv[++i]);
+		} else if (string(argv[i]) == "--height" && i + 1 < argc) {
+			frameHeight = atoi(argv[++i]);
+		} else if (string(argv[i]) == "--pyramid") {
+			usePyramid = true;
+		} else if (string(argv[i]) == "--camshift") {
+			useCamShift = true;
+		} else if (string(argv[i]) == "--roi" && i + 1 < argc) {
+			int r[4];
+			if (sscanf(argv[++i], "%d,%d,%d,%d", &r[0], &r[1], &r[2], &r[3]) != 4) {
+				std::cout << "Invalid ROI, expected x,y,w,h" << std::endl;
+				return -1;
+			}
+			selection = Rect(r[0], r[1], r[2], r[3]);
+			selected = true;
+			useCamShift = true;
+		} else if (string(argv[i]) == "--motion-gate") {
+			useMotionGate = true;
+		} else if (string(argv[i]) == "--headless") {
+			headless = true;
+		} else if (string(argv[i]) == "--record" && i + 1 < argc) {
+			recordPath = argv[++i];
+		} else if (string(argv[i]) == "--record-annotated" && i + 1 < argc) {
+			annotatedPath = argv[++i];
+		} else if (string(argv[i]) == "--record-policy" && i + 1 < argc) {
+			dropPolicy = argv[++i];
+		} else {
+			std::cout << "Usage: " << argv[0];
+			std::cout << " [--source <spec>] [--stats <file>]";
+			std::cout << " [--width <px>] [--height <px>] [--pyramid]";
+			std::cout << " [--motion-gate] [--camshift] [--roi x,y,w,h]";
+			std::cout << " [--record <file>] [--record-annotated <file>]";
+			std::cout << " [--record-policy oldest|newest] [--headless]";
+			std::cout << std::endl;
+			return -1;
+		}
+	}
+
+	//create slider bars for HSV filtering and open frame source at
+	//the capture frame height and width
+	if (!headless)
+		createTrackbars();
+	source = openFrameSource(sourceSpec, Size(frameWidth, frameHeight));
+	if (source.empty()) {
+		return -1;
+	}
+
+	// drag a box around the object to track in CamShift mode
+	if (useCamShift && !headless) {
+		namedWindow(windowName, 1);
+		setMouseCallback(windowName, on_mouse, NULL);
+	}
+
+	// encode the annotated view in the background
+	if (!annotatedPath.empty()) {
+		annotated = new VideoRecorder(
+			"annotated",
+			annotatedPath,
+			OUTPUT_FPS,
+			parseDropPolicy(dropPolicy)
+		);
+	}
+
+	// native capture formats are only decoded to BGR when something reads
+	// the feed: the windows, the annotated recording and the modes that
+	// work on BGR images. The plain mode thresholds straight from YUV.
+	needFeed = !headless || !annotated.empty()
+		|| useCamShift || usePyramid || useMotionGate;
 
-	//set height and width of capture frame
-	capture.set(CV_CAP_PROP_FRAME_WIDTH, FRAME_WIDTH);
-	capture.set(CV_CAP_PROP_FRAME_HEIGHT, FRAME_HEIGHT);
+	// record raw frames before anything is drawn on them
+	if (!recordPath.empty()) {
+		source = new RecordingSource(source, recordPath);
+		if (!source->isOpened()) {
+			return -1;
+		}
+	}
 
 	while(1){
-		capture.read(cameraFeed);
-		cvtColor(cameraFeed, HSV, COLOR_BGR2HSV);  // convert from BGR to HSV
+		STATS_SCOPE("frame");
+		{
+			STATS_SCOPE("capture");
+			if (!source->read(frame)) {
+				break;
+			}
+		}
+		STATS_COUNT("frames", 1);
+		// decoded feeds handed to the annotated recorder may still be
+		// encoding, decode the next one into a buffer of its own instead
+		// of over them
+		if (needFeed) {
+			if (!annotated.empty() && frame.format != FORMAT_BGR)
+				cameraFeed.release();
+			frameToBGR(frame, cameraFeed);
+		}
 
-		// filter HSV image between values and store filtered image to
-		// threshold matrix
-		inRange(HSV,Scalar(H_MIN, S_MIN, V_MIN), Scalar(H_MAX, S_MAX, V_MAX),threshold);
+		// find the tiles that changed since they were last processed, on
+		// the Y plane of native capture formats, BGR frames are downscaled
+		// by the gate before their grey conversion
+		if (useMotionGate) {
+			if (filterChanged(hsvMin, hsvMax))
+				gate.invalidate();
+			if (frame.format == FORMAT_BGR) {
+				changedTiles = gate.update(frame.image);
+			} else {
+				frameToGray(frame, gray);
+				changedTiles = gate.update(gray);
+			}
+		}
 
-		// perform morphological operations on thresholded image to eliminate noise
-		// and emphasize the filtered object(s)
-		if(useMorphOps)
-            		morphOps(threshold);
+		if (useCamShift) {
+			// follow a learned colour histogram instead of thresholds
+			trackCamShift(tracker, cameraFeed, threshold);
+		} else if (useMotionGate && changedTiles == 0) {
+			// static scene, the cached results still hold
+			STATS_COUNT("frames_skipped", 1);
+			if (usePyramid)
+				drawPyramidObjects(pyramidFound, pyramidObjects, cameraFeed);
+			else
+				drawTrackingStatus(trackingStatus, x, y, cameraFeed);
+		} else if (usePyramid) {
+			// detect on a downscaled level and refine at full resolution,
+			// the gate only skips static frames here, any change runs the
+			// whole pyramid again
+			pyramidFound = trackPyramidObjects(
+				cameraFeed,
+				threshold,
+				useMorphOps,
+				pyramidObjects
+			);
+			drawPyramidObjects(pyramidFound, pyramidObjects, cameraFeed);
+		} else if (useMotionGate) {
+			// only threshold the changed tiles, grown by how far the
+			// morphological operations spread a change
+			thresholdRegions(
+				cameraFeed,
+				gate.changedRegions(useMorphOps ? MORPH_REACH : 0),
+				hsvMin,
+				hsvMax,
+				useMorphOps,
+				HSV,
+				threshold
+			);
+			// the contour search still covers the whole threshold, a blob
+			// can reach across tiles and the tracked object may sit in
+			// tiles that did not change
+			if(trackObjects)
+				trackingStatus = trackFilteredObject(x, y, threshold, cameraFeed);
+		} else {
+			// convert to HSV, straight from YUV for native capture formats
+			frameToHSV(frame, HSV);
+
+			// filter HSV image between values and store filtered image to
+			// threshold matrix
+			{
+				STATS_SCOPE("threshold");
+				inRange(HSV,Scalar(H_MIN, S_MIN, V_MIN), Scalar(H_MAX, S_MAX, V_MAX),threshold);
+			}
 
-		// pass in thresholded frame to our object tracking function
-		// this function will return the x and y coordinates of the
-		// filtered object
-		if(trackObjects)
-			trackFilteredObject(x, y, threshold, cameraFeed);
+			// perform morphological operations on thresholded image to eliminate noise
+			// and emphasize the filtered object(s)
+			if(useMorphOps)
+	            		morphOps(threshold);
+
+			// pass in thresholded frame to our object tracking function
+			// this function will return the x and y coordinates of the
+			// filtered object, nothing is drawn without a feed
+			if(trackObjects)
+				trackFilteredObject(x, y, threshold, cameraFeed);
+		}
+
+		// the feed is not drawn on after this, hand it over as is. BGR
+		// feeds are views of the frame, which keeps their pool buffer
+		// alive, decoded feeds were allocated for this frame alone
+		if (!annotated.empty()) {
+			Frame annotatedFrame = frame;
+			annotatedFrame.image = cameraFeed;
+			annotatedFrame.format = FORMAT_BGR;
+			annotated->write(annotatedFrame);
+		}
+
+		if (headless)
+			continue;
 
 		// show frames
-		imshow(windowName2, threshold);
-		imshow(windowName, cameraFeed);
-		imshow(windowName1, HSV);
+		{
+			STATS_SCOPE("display");
+			if (!threshold.empty())
+				imshow(windowName2, threshold);
+			imshow(windowName, cameraFeed);
+			if (!usePyramid && !useCamShift)
+				imshow(windowName1, HSV);
+		}
 
 		// delay 30ms so that screen can refresh.
 		// image will not appear without this waitKey() command
+		STATS_SCOPE("wait_key");
 		waitKey(30);
 	}
+	statsStop();
 
 	return 0;
 }
@@ -0,0 +1,336 @@
+#include <algorithm>
+
+#include <opencv2/core/core.hpp>
+#include <opencv2/imgproc/imgproc.hpp>
+
+#include <eyes/pixelFormat.hpp>
+#include <eyes/stats.hpp>
+
+// BT.601 limited range YUV to RGB, fixed point with the constants OpenCV's
+// YUV conversions use
+#define YUV_SHIFT 20
+#define YUV_CY 1220542
+#define YUV_CUB 2116026
+#define YUV_CUG -409993
+#define YUV_CVG -852492
+#define YUV_CVR 1673527
+
+// HSV division tables, fixed point the same as cvtColor
+#define HSV_SHIFT 12
+
+struct yuv_tables
+{
+    int y[256];
+    int ub[256];
+    int ug[256];
+    int vg[256];
+    int vr[256];
+    int sdiv[256];
+    int hdiv[256];
+};
+
+static struct yuv_tables buildTables()
+{
+    struct yuv_tables t;
+
+    for (int i = 0; i < 256; i++) {
+        t.y[i] = std::max(0, i - 16) * YUV_CY + (1 << (YUV_SHIFT - 1));
+        t.ub[i] = (i - 128) * YUV_CUB;
+        t.ug[i] = (i - 128) * YUV_CUG;
+        t.vg[i] = (i - 128) * YUV_CVG;
+        t.vr[i] = (i - 128) * YUV_CVR;
+
+        t.sdiv[i] = i ? cvRound((255 << HSV_SHIFT) / (double) i) : 0;
+        t.hdiv[i] = i ? cvRound((180 << HSV_SHIFT) / (6.0 * i)) : 0;
+    }
+
+    return t;
+}
+
+static const struct yuv_tables &yuvTables()
+{
+    static const struct yuv_tables tables = buildTables();
+    return tables;
+}
+
+// chroma terms, shared by every pixel of a chroma sample
+struct chroma
+{
+    int r;
+    int g;
+    int b;
+};
+
+static inline struct chroma chromaTerms(const struct yuv_tables &t, int u, int v)
+{
+    struct chroma c;
+
+    c.r = t.vr[v];
+    c.g = t.ug[u] + t.vg[v];
+    c.b = t.ub[u];
+    return c;
+}
+
+static inline void yuvToHSV(
+    const struct yuv_tables &t,
+    int y,
+    const struct chroma &c,
+    uchar *dst)
+{
+    int yy = t.y[y];
+    int r = cv::saturate_cast<uchar>((yy + c.r) >> YUV_SHIFT);
+    int g = cv::saturate_cast<uchar>((yy + c.g) >> YUV_SHIFT);
+    int b = cv::saturate_cast<uchar>((yy + c.b) >> YUV_SHIFT);
+    int v = std::max(r, std::max(g, b));
+    int diff = v - std::min(r, std::min(g, b));
+    int h;
+
+    if (v == r) {
+        h = g - b;
+    } else if (v == g) {
+        h = b - r + 2 * diff;
+    } else {
+        h = r - g + 4 * diff;
+    }
+    h = (h * t.hdiv[diff] + (1 << (HSV_SHIFT - 1))) >> HSV_SHIFT;
+
+    dst[0] = h < 0 ? h + 180 : h;
+    dst[1] = (diff * t.sdiv[v] + (1 << (HSV_SHIFT - 1))) >> HSV_SHIFT;
+    dst[2] = v;
+}
+
+
+// GRAY
+template <>
+void convertToGray<FORMAT_BGR>(const cv::Mat &src, cv::Mat &gray)
+{
+    cv::cvtColor(src, gray, CV_BGR2GRAY);
+}
+
+template <>
+void convertToGray<FORMAT_GRAY>(const cv::Mat &src, cv::Mat &gray)
+{
+    gray = src;
+}
+
+template <>
+void convertToGray<FORMAT_YUYV>(const cv::Mat &src, cv::Mat &gray)
+{
+    // luma is interleaved with chroma and a single channel Mat cannot step
+    // over every other byte, so this is the one copy that is left
+    int from_to[] = {0, 0};
+
+    gray.create(src.size(), CV_8UC1);
+    cv::mixChannels(&src, 1, &gray, 1, from_to, 1);
+}
+
+template <>
+void convertToGray<FORMAT_NV12>(const cv::Mat &src, cv::Mat &gray)
+{
+    gray = src.rowRange(0, src.rows * 2 / 3);
+}
+
+
+// HSV
+template <>
+void convertToHSV<FORMAT_BGR>(const cv::Mat &src, cv::Mat &hsv)
+{
+    cv::cvtColor(src, hsv, cv::COLOR_BGR2HSV);
+}
+
+template <>
+void convertToHSV<FORMAT_GRAY>(const cv::Mat &src, cv::Mat &hsv)
+{
+    // no hue and no saturation, value is the grey level
+    int from_to[] = {0, 2};
+
+    hsv.create(src.size(), CV_8UC3);
+    hsv.setTo(cv::Scalar::all(0));
+    cv::mixChannels(&src, 1, &hsv, 1, from_to, 1);
+}
+
+template <>
+void convertToHSV<FORMAT_YUYV>(const cv::Mat &src, cv::Mat &hsv)
+{
+    const struct yuv_tables &t = yuvTables();
+
+    hsv.create(src.size(), CV_8UC3);
+    for (int row = 0; row < src.rows; row++) {
+        const uchar *yuyv = src.ptr<uchar>(row);
+        uchar *dst = hsv.ptr<uchar>(row);
+
+        // Y0 U Y1 V
+        for (int x = 0; x + 1 < src.cols; x += 2, yuyv += 4, dst += 6) {
+            struct chroma c = chromaTerms(t, yuyv[1], yuyv[3]);
+
+            yuvToHSV(t, yuyv[0], c, dst);
+            yuvToHSV(t, yuyv[2], c, dst + 3);
+        }
+    }
+}
+
+template <>
+void convertToHSV<FORMAT_NV12>(const cv::Mat &src, cv::Mat &hsv)
+{
+    const struct yuv_tables &t = yuvTables();
+    int height = src.rows * 2 / 3;
+
+    hsv.create(height, src.cols, CV_8UC3);
+    for (int row = 0; row + 1 < height; row += 2) {
+        const uchar *y0 = src.ptr<uchar>(row);
+        const uchar *y1 = src.ptr<uchar>(row + 1);
+        const uchar *uv = src.ptr<uchar>(height + row / 2);
+        uchar *dst0 = hsv.ptr<uchar>(row);
+        uchar *dst1 = hsv.ptr<uchar>(row + 1);
+
+        // one UV pair per 2x2 block
+        for (int x = 0; x + 1 < src.cols; x += 2) {
+            struct chroma c = chromaTerms(t, uv[x], uv[x + 1]);
+
+            yuvToHSV(t, y0[x], c, dst0 + x * 3);
+            yuvToHSV(t, y0[x + 1], c, dst0 + x * 3 + 3);
+            yuvToHSV(t, y1[x], c, dst1 + x * 3);
+            yuvToHSV(t, y1[x + 1], c, dst1 + x * 3 + 3);
+        }
+    }
+}
+
+
+// BGR
+template <>
+void convertToBGR<FORMAT_BGR>(const cv::Mat &src, cv::Mat &bgr)
+{
+    bgr = src;
+}
+
+template <>
+void convertToBGR<FORMAT_GRAY>(const cv::Mat &src, cv::Mat &bgr)
+{
+    cv::cvtColor(src, bgr, CV_GRAY2BGR);
+}
+
+template <>
+void convertToBGR<FORMAT_YUYV>(const cv::Mat &src, cv::Mat &bgr)
+{
+    cv::cvtColor(src, bgr, cv::COLOR_YUV2BGR_YUYV);
+}
+
+template <>
+void convertToBGR<FORMAT_NV12>(const cv::Mat &src, cv::Mat &bgr)
+{
+    cv::cvtColor(src, bgr, cv::COLOR_YUV2BGR_NV12);
+}
+
+
+// FRAMES
+void frameToGray(const Frame &frame, cv::Mat &gray)
+{
+    STATS_SCOPE("gray_convert");
+
+    switch (frame.format) {
+    case FORMAT_BGR: convertToGray<FORMAT_BGR>(frame.image, gray); break;
+    case FORMAT_GRAY: convertToGray<FORMAT_GRAY>(frame.image, gray); break;
+    case FORMAT_YUYV: convertToGray<FORMAT_YUYV>(frame.image, gray); break;
+    case FORMAT_NV12: convertToGray<FORMAT_NV12>(frame.image, gray); break;
+    }
+}
+
+void frameToHSV(const Frame &frame, cv::Mat &hsv)
+{
+    STATS_SCOPE("hsv_convert");
+
+    switch (frame.format) {
+    case FORMAT_BGR: convertToHSV<FORMAT_BGR>(frame.image, hsv); break;
+    case FORMAT_GRAY: convertToHSV<FORMAT_GRAY>(frame.image, hsv); break;
+    case FORMAT_YUYV: convertToHSV<FORMAT_YUYV>(frame.image, hsv); break;
+    case FORMAT_NV12: convertToHSV<FORMAT_NV12>(frame.image, hsv); break;
+    }
+}
+
+void frameToBGR(const Frame &frame, cv::Mat &bgr)
+{
+    switch (frame.format) {
+    case FORMAT_BGR: convertToBGR<FORMAT_BGR>(frame.image, bgr); break;
+    case FORMAT_GRAY: convertToBGR<FORMAT_GRAY>(frame.image, bgr); break;
+    case FORMAT_YUYV: convertToBGR<FORMAT_YUYV>(frame.image, bgr); break;
+    case FORMAT_NV12: convertToBGR<FORMAT_NV12>(frame.image, bgr); break;
+    }
+}
+
+
+// PACKING
+static inline uchar lumaOf(const cv::Vec3b &p)
+{
+    return cv::saturate_cast<uchar>(16 + 0.098 * p[0] + 0.504 * p[1] + 0.257 * p[2]);
+}
+
+static inline uchar uOf(double b, double g, double r)
+{
+    return cv::saturate_cast<uchar>(128 + 0.439 * b - 0.291 * g - 0.148 * r);
+}
+
+static inline uchar vOf(double b, double g, double r)
+{
+    return cv::saturate_cast<uchar>(128 - 0.071 * b - 0.368 * g + 0.439 * r);
+}
+
+void convertFromBGR(const cv::Mat &bgr, enum frame_format format, cv::Mat &dst)
+{
+    switch (format) {
+    case FORMAT_BGR:
+        bgr.copyTo(dst);
+        break;
+
+    case FORMAT_GRAY:
+        dst.create(bgr.size(), CV_8UC1);
+        for (int row = 0; row < bgr.rows; row++) {
+            for (int x = 0; x < bgr.cols; x++) {
+                dst.at<uchar>(row, x) = lumaOf(bgr.at<cv::Vec3b>(row, x));
+            }
+        }
+        break;
+
+    case FORMAT_YUYV:
+        dst.create(bgr.size(), CV_8UC2);
+        for (int row = 0; row < bgr.rows; row++) {
+            for (int x = 0; x + 1 < bgr.cols; x += 2) {
+                cv::Vec3b p0 = bgr.at<cv::Vec3b>(row, x);
+                cv::Vec3b p1 = bgr.at<cv::Vec3b>(row, x + 1);
+                double b = (p0[0] + p1[0]) / 2.0;
+                double g = (p0[1] + p1[1]) / 2.0;
+                double r = (p0[2] + p1[2]) / 2.0;
+
+                dst.at<cv::Vec2b>(row, x) = cv::Vec2b(lumaOf(p0), uOf(b, g, r));
+                dst.at<cv::Vec2b>(row, x + 1) = cv::Vec2b(lumaOf(p1), vOf(b, g, r));
+            }
+        }
+        break;
+
+    case FORMAT_NV12:
+        dst.create(bgr.rows * 3 / 2, bgr.cols, CV_8UC1);
+        for (int row = 0; row < bgr.rows; row++) {
+            for (int x = 0; x < bgr.cols; x++) {
+                dst.at<uchar>(row, x) = lumaOf(bgr.at<cv::Vec3b>(row, x));
+            }
+        }
+        for (int row = 0; row + 1 < bgr.rows; row += 2) {
+            uchar *uv = dst.ptr<uchar>(bgr.rows + row / 2);
+
+            for (int x = 0; x + 1 < bgr.cols; x += 2) {
+                cv::Vec3b p[4] = {
+                    bgr.at<cv::Vec3b>(row, x),
+                    bgr.at<cv::Vec3b>(row, x + 1),
+                    bgr.at<cv::Vec3b>(row + 1, x),
+                    bgr.at<cv::Vec3b>(row + 1, x + 1)
+                };
+                double b = (p[0][0] + p[1][0] + p[2][0] + p[3][0]) / 4.0;
+                double g = (p[0][1] + p[1][1] + p[2][1] + p[3][1]) / 4.0;
+                double r = (p[0][2] + p[1][2] + p[2][2] + p[3][2]) / 4.0;
+
+                uv[x] = uOf(b, g, r);
+                uv[x + 1] = vOf(b, g, r);
+            }
+        }
+        break;
+    }
+}
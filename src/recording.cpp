@@ -0,0 +1,524 @@
+#include <errno.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <chrono>
+#include <sstream>
+
+#include <dbg/dbg.h>
+
+#include <eyes/recording.hpp>
+#include <eyes/stats.hpp>
+
+static int64_t wallClock()
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()
+    ).count();
+}
+
+static int padTo(FILE *fp, int alignment)
+{
+    static const char padding[RECORDING_ALIGNMENT] = {0};
+    long pos = ftell(fp);
+    long aligned = (pos + alignment - 1) / alignment * alignment;
+
+    if (pos < 0 || fwrite(padding, 1, aligned - pos, fp) != (size_t) (aligned - pos)) {
+        return -1;
+    }
+    return 0;
+}
+
+
+// FRAME RECORDER
+FrameRecorder::FrameRecorder(
+    const std::string &path,
+    int num_streams,
+    size_t queue_capacity)
+    : path(path),
+      fp(NULL),
+      failed(false),
+      records(0),
+      pool(queue_capacity + 2),
+      queue(queue_capacity)
+{
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, RECORDING_MAGIC, sizeof(RECORDING_MAGIC));
+    header.version = RECORDING_VERSION;
+    header.num_streams = num_streams;
+
+    if (num_streams < 1 || num_streams > RECORDING_MAX_STREAMS) {
+        log_err("Invalid number of recording streams %d!", num_streams);
+        return;
+    }
+
+    fp = fopen(path.c_str(), "wb");
+    if (fp == NULL) {
+        log_err("Failed to open recording [%s]!", path.c_str());
+        return;
+    }
+    if (fwrite(&header, sizeof(header), 1, fp) != 1) {
+        log_err("Failed to write recording [%s]!", path.c_str());
+        fclose(fp);
+        fp = NULL;
+        return;
+    }
+
+    writer = std::thread(&FrameRecorder::writeFrames, this);
+}
+
+FrameRecorder::~FrameRecorder()
+{
+    close();
+}
+
+bool FrameRecorder::isOpened() const
+{
+    return fp != NULL;
+}
+
+bool FrameRecorder::record(const Frame &frame)
+{
+    return record(std::vector<Frame>(1, frame));
+}
+
+bool FrameRecorder::record(const Frame &left, const Frame &right)
+{
+    std::vector<Frame> frames;
+    frames.push_back(left);
+    frames.push_back(right);
+    return record(frames);
+}
+
+bool FrameRecorder::record(const std::vector<Frame> &frames)
+{
+    struct item item;
+
+    if (fp == NULL || frames.size() != header.num_streams) {
+        return false;
+    }
+
+    // a record the queue would drop is not worth copying, the recorder is
+    // fed from a single capture loop so a record that passes this check
+    // finds room
+    item.record = records++;
+    if (queue.wouldDrop()) {
+        queue.drop();
+        STATS_COUNT("recording_dropped", frames.size());
+        return false;
+    }
+
+    // the capture loop is free to draw on its frames once this returns
+    for (size_t i = 0; i < frames.size(); i++) {
+        Frame copy = pool.acquire(frames[i].image.size(), frames[i].image.type());
+
+        frames[i].image.copyTo(copy.image);
+        copy.format = frames[i].format;
+        copy.timestamp = frames[i].timestamp;
+        copy.sequence = frames[i].sequence;
+        item.frames.push_back(copy);
+    }
+
+    if (!queue.push(item)) {
+        STATS_COUNT("recording_dropped", frames.size());
+        return false;
+    }
+    STATS_COUNT("recording_frames", frames.size());
+
+    return true;
+}
+
+int FrameRecorder::close()
+{
+    if (fp == NULL) {
+        return failed ? -1 : 0;
+    }
+
+    queue.close();
+    writer.join();
+    if (!failed && writeChunk() != 0) {
+        fail();
+    }
+    if (fclose(fp) != 0 && !failed) {
+        fail();
+    }
+    fp = NULL;
+
+    if (queue.dropped()) {
+        log_warn("Recording dropped %llu records", (unsigned long long) queue.dropped());
+    }
+
+    return failed ? -1 : 0;
+}
+
+uint64_t FrameRecorder::dropped() const
+{
+    return queue.dropped();
+}
+
+bool FrameRecorder::hasFailed() const
+{
+    return failed;
+}
+
+void FrameRecorder::fail()
+{
+    log_err("Failed to write recording [%s]: %s", path.c_str(), strerror(errno));
+    STATS_COUNT("recording_errors", 1);
+    failed = true;
+
+    // later records are dropped, what is queued is drained unwritten
+    queue.close();
+}
+
+void FrameRecorder::writeFrames()
+{
+    struct item item;
+
+    while (queue.pop(item)) {
+        STATS_SCOPE("recording_write");
+
+        for (size_t i = 0; i < item.frames.size() && !failed; i++) {
+            if (writeFrame(item.record, i, item.frames[i]) != 0) {
+                fail();
+            }
+        }
+        if (failed) {
+            STATS_COUNT("recording_dropped", item.frames.size());
+        }
+        item.frames.clear();
+    }
+}
+
+int FrameRecorder::writeFrame(
+    uint64_t record,
+    uint32_t stream,
+    const Frame &frame)
+{
+    struct recording_entry entry;
+
+    if (padTo(fp, RECORDING_ALIGNMENT) != 0) {
+        return -1;
+    }
+
+    memset(&entry, 0, sizeof(entry));
+    entry.offset = ftell(fp);
+    entry.size = frame.image.total() * frame.image.elemSize();
+    entry.timestamp = frame.timestamp;
+    entry.record = record;
+    entry.stream = stream;
+    entry.type = frame.image.type();
+    entry.rows = frame.image.rows;
+    entry.cols = frame.image.cols;
+    entry.format = frame.format;
+
+    // pooled buffers are always continuous
+    if (fwrite(frame.image.data, 1, entry.size, fp) != entry.size) {
+        return -1;
+    }
+
+    chunk.push_back(entry);
+    if (chunk.size() >= RECORDING_CHUNK_FRAMES) {
+        return writeChunk();
+    }
+    return 0;
+}
+
+int FrameRecorder::writeChunk()
+{
+    struct recording_chunk trailer;
+    long offset;
+
+    if (chunk.empty()) {
+        return 0;
+    }
+
+    // chunk index
+    if (padTo(fp, RECORDING_ALIGNMENT) != 0 || (offset = ftell(fp)) < 0) {
+        return -1;
+    }
+
+    memset(&trailer, 0, sizeof(trailer));
+    memcpy(trailer.magic, CHUNK_MAGIC, sizeof(CHUNK_MAGIC));
+    trailer.num_entries = chunk.size();
+    trailer.previous_chunk = header.last_chunk;
+    if (fwrite(&trailer, sizeof(trailer), 1, fp) != 1
+            || fwrite(&chunk[0], sizeof(struct recording_entry), chunk.size(), fp) != chunk.size()) {
+        return -1;
+    }
+
+    // publish the chunk in the header, only once it is on disk, so a
+    // recording cut short still indexes every chunk it points at
+    if (fflush(fp) != 0) {
+        return -1;
+    }
+    header.last_chunk = offset;
+    header.num_frames += chunk.size();
+    if (fseek(fp, 0, SEEK_SET) != 0
+            || fwrite(&header, sizeof(header), 1, fp) != 1
+            || fseek(fp, 0, SEEK_END) != 0
+            || fflush(fp) != 0) {
+        return -1;
+    }
+
+    chunk.clear();
+    return 0;
+}
+
+
+// RECORDING SOURCE
+RecordingSource::RecordingSource(
+    cv::Ptr<FrameSource> source,
+    const std::string &path)
+    : source(source), recorder(new FrameRecorder(path, 1))
+{
+}
+
+bool RecordingSource::isOpened() const
+{
+    return source->isOpened() && recorder->isOpened();
+}
+
+bool RecordingSource::read(Frame &frame)
+{
+    if (!source->read(frame)) {
+        return false;
+    }
+
+    recorder->record(frame);
+    return true;
+}
+
+cv::Size RecordingSource::size() const
+{
+    return source->size();
+}
+
+std::string RecordingSource::name() const
+{
+    return source->name();
+}
+
+
+// RECORDING FILE
+RecordingFile::RecordingFile()
+    : mapping(NULL), mapping_size(0), num_streams(0)
+{
+}
+
+RecordingFile::~RecordingFile()
+{
+    if (mapping) {
+        munmap(mapping, mapping_size);
+    }
+}
+
+std::shared_ptr<RecordingFile> RecordingFile::open(const std::string &path)
+{
+    std::shared_ptr<RecordingFile> file(new RecordingFile());
+    std::vector<uint64_t> chunks;
+    struct recording_header *header;
+    struct stat st;
+    uint64_t offset;
+    int fd;
+
+    // map file
+    fd = ::open(path.c_str(), O_RDONLY);
+    if (fd == -1) {
+        log_err("Failed to open recording [%s]!", path.c_str());
+        return std::shared_ptr<RecordingFile>();
+    }
+
+    if (fstat(fd, &st) == -1 || (size_t) st.st_size < sizeof(*header)) {
+        log_err("Invalid recording [%s]!", path.c_str());
+        ::close(fd);
+        return std::shared_ptr<RecordingFile>();
+    }
+
+    // private writable mapping, so consumers may draw on replayed frames
+    file->mapping = (char *) mmap(
+        NULL,
+        st.st_size,
+        PROT_READ | PROT_WRITE,
+        MAP_PRIVATE,
+        fd,
+        0
+    );
+    ::close(fd);
+    if (file->mapping == MAP_FAILED) {
+        file->mapping = NULL;
+        log_err("Failed to mmap recording [%s]!", path.c_str());
+        return std::shared_ptr<RecordingFile>();
+    }
+    file->mapping_size = st.st_size;
+
+    // check header
+    header = (struct recording_header *) file->mapping;
+    if (memcmp(header->magic, RECORDING_MAGIC, sizeof(RECORDING_MAGIC)) != 0) {
+        log_err("[%s] is not a recording!", path.c_str());
+        return std::shared_ptr<RecordingFile>();
+    } else if (header->version != RECORDING_VERSION) {
+        log_err("Unsupported recording version %u!", header->version);
+        return std::shared_ptr<RecordingFile>();
+    } else if (header->num_streams < 1
+            || header->num_streams > RECORDING_MAX_STREAMS) {
+        log_err("Invalid number of streams in [%s]!", path.c_str());
+        return std::shared_ptr<RecordingFile>();
+    }
+    file->num_streams = header->num_streams;
+    file->streams.resize(file->num_streams);
+
+    // walk the chunk chain back from the last complete chunk
+    for (offset = header->last_chunk; offset != 0; ) {
+        struct recording_chunk *trailer;
+
+        if (offset > file->mapping_size - sizeof(*trailer)
+                || std::find(chunks.begin(), chunks.end(), offset) != chunks.end()) {
+            log_err("Corrupt chunk chain in [%s]!", path.c_str());
+            return std::shared_ptr<RecordingFile>();
+        }
+
+        trailer = (struct recording_chunk *) (file->mapping + offset);
+        if (memcmp(trailer->magic, CHUNK_MAGIC, sizeof(CHUNK_MAGIC)) != 0) {
+            log_err("Corrupt chunk in [%s]!", path.c_str());
+            return std::shared_ptr<RecordingFile>();
+        }
+
+        chunks.push_back(offset);
+        offset = trailer->previous_chunk;
+    }
+
+    // index frames in recording order
+    for (size_t c = chunks.size(); c-- > 0; ) {
+        struct recording_chunk *trailer =
+            (struct recording_chunk *) (file->mapping + chunks[c]);
+        struct recording_entry *entries =
+            (struct recording_entry *) (trailer + 1);
+
+        if ((uint64_t) trailer->num_entries * sizeof(*entries)
+                > file->mapping_size - chunks[c] - sizeof(*trailer)) {
+            log_err("Truncated chunk in [%s]!", path.c_str());
+            return std::shared_ptr<RecordingFile>();
+        }
+
+        for (uint32_t i = 0; i < trailer->num_entries; i++) {
+            struct recording_entry *e = &entries[i];
+
+            // bound every term before multiplying or adding
+            if (e->rows < 0 || e->cols < 0
+                    || e->type != CV_MAT_TYPE(e->type)
+                    || (uint64_t) e->rows * e->cols > file->mapping_size
+                    || e->offset > file->mapping_size
+                    || e->size > file->mapping_size - e->offset) {
+                log_err("Corrupt frame index in [%s]!", path.c_str());
+                return std::shared_ptr<RecordingFile>();
+            }
+
+            uint64_t expected = (uint64_t) e->rows * e->cols * CV_ELEM_SIZE(e->type);
+            if (e->stream >= (uint32_t) file->num_streams
+                    || e->format > FORMAT_NV12
+                    || e->size != expected) {
+                log_err("Corrupt frame index in [%s]!", path.c_str());
+                return std::shared_ptr<RecordingFile>();
+            }
+            file->streams[e->stream].push_back(*e);
+        }
+    }
+
+    return file;
+}
+
+int RecordingFile::numStreams() const
+{
+    return num_streams;
+}
+
+const std::vector<struct recording_entry> &RecordingFile::stream(int index) const
+{
+    return streams[index];
+}
+
+cv::Mat RecordingFile::image(const struct recording_entry &entry) const
+{
+    return cv::Mat(entry.rows, entry.cols, entry.type, mapping + entry.offset);
+}
+
+
+// REPLAY SOURCE
+ReplaySource::ReplaySource(const std::string &path, int stream, bool realtime)
+    : path(path),
+      stream_index(stream),
+      realtime(realtime),
+      index(0),
+      start(0),
+      file(RecordingFile::open(path))
+{
+    if (file && (stream < 0 || stream >= file->numStreams())) {
+        log_err("Recording [%s] has no stream %d!", path.c_str(), stream);
+        file.reset();
+    }
+}
+
+bool ReplaySource::isOpened() const
+{
+    return file && !file->stream(stream_index).empty();
+}
+
+bool ReplaySource::read(Frame &frame)
+{
+    const std::vector<struct recording_entry> &entries = file->stream(stream_index);
+    const struct recording_entry *entry;
+
+    if (index >= entries.size()) {
+        frame = Frame();
+        return false;
+    }
+    entry = &entries[index++];
+
+    // keep the original spacing between frames
+    if (realtime) {
+        int64_t due;
+
+        if (start == 0) {
+            start = wallClock();
+        }
+        due = start + (entry->timestamp - entries[0].timestamp);
+        if (due > wallClock()) {
+            std::this_thread::sleep_for(std::chrono::microseconds(due - wallClock()));
+        }
+    }
+
+    frame = Frame();
+    frame.image = file->image(*entry);
+    frame.format = (enum frame_format) entry->format;
+    frame.timestamp = entry->timestamp;
+    frame.sequence = entry->record;
+    frame.buffer = file;
+    return true;
+}
+
+cv::Size ReplaySource::size() const
+{
+    if (!isOpened()) {
+        return cv::Size();
+    }
+
+    const struct recording_entry &entry = file->stream(stream_index)[0];
+    if (entry.format == FORMAT_NV12) {
+        return cv::Size(entry.cols, entry.rows * 2 / 3);
+    }
+    return cv::Size(entry.cols, entry.rows);
+}
+
+std::string ReplaySource::name() const
+{
+    std::stringstream ss;
+    ss << "replay:" << path << ":" << stream_index;
+    if (!realtime) {
+        ss << ":fast";
+    }
+    return ss.str();
+}
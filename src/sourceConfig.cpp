@@ -0,0 +1,203 @@
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <thread>
+
+#include <dbg/dbg.h>
+
+#include <eyes/sourceConfig.hpp>
+#include <eyes/stats.hpp>
+
+static bool deviceOrder(const struct video_device &a, const struct video_device &b)
+{
+    return a.index < b.index;
+}
+
+static std::string readSysfs(const std::string &path)
+{
+    std::ifstream file(path.c_str());
+    std::string value;
+
+    std::getline(file, value);
+    return value;
+}
+
+
+// DEVICES
+std::vector<struct video_device> enumerateVideoDevices()
+{
+    std::vector<struct video_device> devices;
+    struct dirent *entry;
+    DIR *dir;
+
+    dir = opendir("/sys/class/video4linux");
+    if (dir == NULL) {
+        return devices;
+    }
+
+    while ((entry = readdir(dir)) != NULL) {
+        struct video_device device;
+        std::string sysfs;
+        std::string node_index;
+
+        if (strncmp(entry->d_name, "video", 5) != 0
+                || entry->d_name[5] < '0' || entry->d_name[5] > '9') {
+            continue;
+        }
+        sysfs = std::string("/sys/class/video4linux/") + entry->d_name;
+
+        // UVC cameras expose a metadata node next to the capture node
+        node_index = readSysfs(sysfs + "/index");
+        if (!node_index.empty() && atoi(node_index.c_str()) != 0) {
+            continue;
+        }
+
+        device.index = atoi(entry->d_name + 5);
+        device.path = std::string("/dev/") + entry->d_name;
+        device.name = readSysfs(sysfs + "/name");
+        devices.push_back(device);
+    }
+    closedir(dir);
+
+    std::sort(devices.begin(), devices.end(), deviceOrder);
+    return devices;
+}
+
+
+// CONFIGURATION
+int loadSourceConfig(const std::string &path, struct source_config *config)
+{
+    cv::FileStorage fs;
+    cv::FileNode node;
+    int width = 0;
+    int height = 0;
+
+    if (!fs.open(path, cv::FileStorage::READ)) {
+        return -1;
+    }
+
+    config->specs.clear();
+    config->devices.clear();
+
+    node = fs["sources"];
+    for (cv::FileNodeIterator it = node.begin(); it != node.end(); ++it) {
+        config->specs.push_back((std::string) *it);
+    }
+    node = fs["devices"];
+    for (cv::FileNodeIterator it = node.begin(); it != node.end(); ++it) {
+        config->devices.push_back((std::string) *it);
+    }
+    fs["width"] >> width;
+    fs["height"] >> height;
+    config->size = cv::Size(width, height);
+
+    if (config->specs.empty()) {
+        log_err("No sources configured in [%s]!", path.c_str());
+        return -1;
+    }
+
+    return 0;
+}
+
+int saveSourceConfig(const std::string &path, const struct source_config *config)
+{
+    cv::FileStorage fs(path, cv::FileStorage::WRITE);
+
+    if (!fs.isOpened()) {
+        log_err("Failed to write source configuration [%s]!", path.c_str());
+        return -1;
+    }
+
+    fs << "sources" << "[";
+    for (size_t i = 0; i < config->specs.size(); i++) {
+        fs << config->specs[i];
+    }
+    fs << "]";
+
+    fs << "devices" << "[";
+    for (size_t i = 0; i < config->devices.size(); i++) {
+        fs << config->devices[i];
+    }
+    fs << "]";
+
+    fs << "width" << config->size.width;
+    fs << "height" << config->size.height;
+
+    return 0;
+}
+
+int discoverSources(
+    const std::string &cache_path,
+    cv::Size size,
+    struct source_config *config,
+    size_t max_sources)
+{
+    std::vector<struct video_device> devices = enumerateVideoDevices();
+    std::vector<std::string> names;
+    struct source_config cached;
+
+    for (size_t i = 0; i < devices.size(); i++) {
+        std::stringstream ss;
+        ss << devices[i].path << " " << devices[i].name;
+        names.push_back(ss.str());
+    }
+
+    // same devices as last time, keep what was configured for them
+    if (!names.empty()
+            && loadSourceConfig(cache_path, &cached) == 0
+            && cached.devices == names) {
+        *config = cached;
+        if (config->size.area() == 0) {
+            config->size = size;
+        }
+        return 0;
+    }
+
+    config->specs.clear();
+    config->devices = names;
+    config->size = size;
+    for (size_t i = 0; i < devices.size(); i++) {
+        std::stringstream ss;
+
+        // every device is a camera open, only take as many as asked for
+        if (i >= max_sources) {
+            log_info("Found camera [%s], not opened", names[i].c_str());
+            continue;
+        }
+        ss << "camera:" << devices[i].index;
+        config->specs.push_back(ss.str());
+        log_info("Found camera [%s]", names[i].c_str());
+    }
+
+    return devices.empty() ? -1 : 0;
+}
+
+
+// OPEN
+std::vector<cv::Ptr<FrameSource> > openFrameSources(
+    const std::vector<std::string> &specs,
+    cv::Size size)
+{
+    std::vector<cv::Ptr<FrameSource> > sources(specs.size());
+    std::vector<std::thread> openers;
+    STATS_SCOPE("open_sources");
+
+    for (size_t i = 0; i < specs.size(); i++) {
+        openers.push_back(std::thread([&sources, &specs, size, i]() {
+            sources[i] = openFrameSource(specs[i], size);
+        }));
+    }
+    for (size_t i = 0; i < openers.size(); i++) {
+        openers[i].join();
+    }
+    for (size_t i = 0; i < sources.size(); i++) {
+        if (sources[i].empty()) {
+            log_err("Failed to open source %d [%s]!", (int) i, specs[i].c_str());
+        }
+    }
+
+    return sources;
+}
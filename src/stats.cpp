@@ -0,0 +1,423 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <thread>
+#include <mutex>
+#include <vector>
+#include <condition_variable>
+
+#include <dbg/dbg.h>
+
+#include <eyes/stats.hpp>
+
+struct stage_histogram
+{
+    std::atomic<uint64_t> buckets[STATS_BUCKETS];
+    std::atomic<uint64_t> count;
+    std::atomic<uint64_t> total;
+    std::atomic<uint64_t> max;
+};
+
+// written only by the owning thread, read by the exporter
+struct thread_stats
+{
+    struct stage_histogram stages[STATS_MAX_STAGES];
+};
+
+// frees the histograms of a thread when it exits
+struct thread_stats_owner
+{
+    struct thread_stats *stats;
+
+    thread_stats_owner() : stats(NULL) {}
+    ~thread_stats_owner();
+};
+
+struct stage_summary
+{
+    uint64_t count;
+    uint64_t total;
+    uint64_t max;
+    uint64_t p50;
+    uint64_t p99;
+};
+
+std::atomic<bool> stats_enabled(false);
+
+static std::mutex registry_lock;
+static std::vector<std::string> stage_names;
+static std::vector<std::string> counter_names;
+static std::vector<std::string> gauge_names;
+static std::vector<struct thread_stats *> threads;
+static struct thread_stats retired;     // merged stats of exited threads
+static std::atomic<uint64_t> counters[STATS_MAX_COUNTERS];
+static std::atomic<int64_t> gauges[STATS_MAX_GAUGES];
+
+static thread_local struct thread_stats_owner local_stats;
+
+static std::thread exporter;
+static std::mutex exporter_lock;
+static std::condition_variable exporter_wake;
+static bool exporter_running = false;
+
+
+// HISTOGRAM
+// log-linear buckets, 4 sub-buckets per power of two
+static int bucketIndex(uint64_t ns)
+{
+    int msb;
+    int index;
+
+    if (ns < 4) {
+        return ns;
+    }
+
+    msb = 63 - __builtin_clzll(ns);
+    index = (msb - 1) * 4 + ((ns >> (msb - 2)) & 3);
+    return (index < STATS_BUCKETS) ? index : STATS_BUCKETS - 1;
+}
+
+static uint64_t bucketUpperBound(int index)
+{
+    int msb;
+    uint64_t width;
+
+    if (index < 4) {
+        return index;
+    }
+
+    msb = index / 4 + 1;
+    width = (uint64_t) 1 << (msb - 2);
+    return (4 + index % 4) * width + width - 1;
+}
+
+static void add(std::atomic<uint64_t> &value, uint64_t n)
+{
+    // single writer, a load and store is enough and avoids a locked RMW
+    value.store(
+        value.load(std::memory_order_relaxed) + n,
+        std::memory_order_relaxed
+    );
+}
+
+static struct thread_stats *threadStats()
+{
+    if (local_stats.stats == NULL) {
+        local_stats.stats = new thread_stats();
+
+        std::lock_guard<std::mutex> guard(registry_lock);
+        threads.push_back(local_stats.stats);
+    }
+
+    return local_stats.stats;
+}
+
+thread_stats_owner::~thread_stats_owner()
+{
+    if (stats == NULL) {
+        return;
+    }
+
+    // keep what the thread recorded, retired is only written under the lock
+    std::lock_guard<std::mutex> guard(registry_lock);
+    for (int s = 0; s < STATS_MAX_STAGES; s++) {
+        struct stage_histogram *from = &stats->stages[s];
+        struct stage_histogram *to = &retired.stages[s];
+        uint64_t max = from->max.load(std::memory_order_relaxed);
+
+        for (int b = 0; b < STATS_BUCKETS; b++) {
+            add(to->buckets[b], from->buckets[b].load(std::memory_order_relaxed));
+        }
+        add(to->count, from->count.load(std::memory_order_relaxed));
+        add(to->total, from->total.load(std::memory_order_relaxed));
+        if (max > to->max.load(std::memory_order_relaxed)) {
+            to->max.store(max, std::memory_order_relaxed);
+        }
+    }
+
+    threads.erase(std::find(threads.begin(), threads.end(), stats));
+    delete stats;
+    stats = NULL;
+}
+
+
+// REGISTRATION AND RECORDING
+static int registerName(
+    std::vector<std::string> &names,
+    const char *name,
+    int max)
+{
+    std::lock_guard<std::mutex> guard(registry_lock);
+
+    for (size_t i = 0; i < names.size(); i++) {
+        if (names[i] == name) {
+            return i;
+        }
+    }
+
+    if ((int) names.size() >= max) {
+        log_warn("Too many stats entries, ignoring [%s]", name);
+        return -1;
+    }
+
+    names.push_back(name);
+    return names.size() - 1;
+}
+
+int statsRegisterStage(const char *name)
+{
+    return registerName(stage_names, name, STATS_MAX_STAGES);
+}
+
+int statsRegisterCounter(const char *name)
+{
+    return registerName(counter_names, name, STATS_MAX_COUNTERS);
+}
+
+int statsRegisterGauge(const char *name)
+{
+    return registerName(gauge_names, name, STATS_MAX_GAUGES);
+}
+
+void statsRecord(int stage, uint64_t nanoseconds)
+{
+    struct stage_histogram *h;
+
+    if (stage < 0) {
+        return;
+    }
+
+    h = &threadStats()->stages[stage];
+    add(h->buckets[bucketIndex(nanoseconds)], 1);
+    add(h->count, 1);
+    add(h->total, nanoseconds);
+    if (nanoseconds > h->max.load(std::memory_order_relaxed)) {
+        h->max.store(nanoseconds, std::memory_order_relaxed);
+    }
+}
+
+void statsCount(int counter, uint64_t n)
+{
+    if (counter >= 0) {
+        counters[counter].fetch_add(n, std::memory_order_relaxed);
+    }
+}
+
+void statsGauge(int gauge, int64_t value)
+{
+    if (gauge >= 0) {
+        gauges[gauge].store(value, std::memory_order_relaxed);
+    }
+}
+
+
+// EXPORT
+static struct stage_summary summarizeStage(int stage)
+{
+    struct stage_summary summary;
+    uint64_t buckets[STATS_BUCKETS];
+    uint64_t seen = 0;
+
+    memset(&summary, 0, sizeof(summary));
+    memset(buckets, 0, sizeof(buckets));
+
+    // merge per thread histograms, and those of threads that exited
+    for (size_t t = 0; t <= threads.size(); t++) {
+        struct stage_histogram *h = (t < threads.size())
+            ? &threads[t]->stages[stage]
+            : &retired.stages[stage];
+        uint64_t max = h->max.load(std::memory_order_relaxed);
+
+        for (int b = 0; b < STATS_BUCKETS; b++) {
+            buckets[b] += h->buckets[b].load(std::memory_order_relaxed);
+        }
+        summary.count += h->count.load(std::memory_order_relaxed);
+        summary.total += h->total.load(std::memory_order_relaxed);
+        summary.max = (max > summary.max) ? max : summary.max;
+    }
+
+    // percentiles, reported as the upper bound of the bucket they fall in
+    for (int b = 0; b < STATS_BUCKETS && summary.count; b++) {
+        seen += buckets[b];
+        if (summary.p50 == 0 && seen * 2 >= summary.count) {
+            summary.p50 = bucketUpperBound(b);
+        }
+        if (seen * 100 >= summary.count * 99) {
+            summary.p99 = bucketUpperBound(b);
+            break;
+        }
+    }
+
+    return summary;
+}
+
+static void writeJSON(FILE *fp)
+{
+    fprintf(fp, "{\n  \"stages\": {");
+    for (size_t i = 0; i < stage_names.size(); i++) {
+        struct stage_summary s = summarizeStage(i);
+
+        fprintf(fp, "%s\n    \"%s\": {", i ? "," : "", stage_names[i].c_str());
+        fprintf(fp, "\"count\": %llu, ", (unsigned long long) s.count);
+        fprintf(fp, "\"mean_us\": %.3f, ", s.count ? s.total / 1e3 / s.count : 0.0);
+        fprintf(fp, "\"p50_us\": %.3f, ", s.p50 / 1e3);
+        fprintf(fp, "\"p99_us\": %.3f, ", s.p99 / 1e3);
+        fprintf(fp, "\"max_us\": %.3f}", s.max / 1e3);
+    }
+    fprintf(fp, "\n  },\n  \"counters\": {");
+    for (size_t i = 0; i < counter_names.size(); i++) {
+        fprintf(
+            fp,
+            "%s\n    \"%s\": %llu",
+            i ? "," : "",
+            counter_names[i].c_str(),
+            (unsigned long long) counters[i].load(std::memory_order_relaxed)
+        );
+    }
+    fprintf(fp, "\n  },\n  \"gauges\": {");
+    for (size_t i = 0; i < gauge_names.size(); i++) {
+        fprintf(
+            fp,
+            "%s\n    \"%s\": %lld",
+            i ? "," : "",
+            gauge_names[i].c_str(),
+            (long long) gauges[i].load(std::memory_order_relaxed)
+        );
+    }
+    fprintf(fp, "\n  }\n}\n");
+}
+
+static void writePrometheus(FILE *fp)
+{
+    fprintf(fp, "# TYPE eyes_stage_latency_seconds summary\n");
+    for (size_t i = 0; i < stage_names.size(); i++) {
+        struct stage_summary s = summarizeStage(i);
+        const char *name = stage_names[i].c_str();
+
+        fprintf(
+            fp,
+            "eyes_stage_latency_seconds{stage=\"%s\",quantile=\"0.5\"} %.9f\n",
+            name,
+            s.p50 / 1e9
+        );
+        fprintf(
+            fp,
+            "eyes_stage_latency_seconds{stage=\"%s\",quantile=\"0.99\"} %.9f\n",
+            name,
+            s.p99 / 1e9
+        );
+        fprintf(
+            fp,
+            "eyes_stage_latency_seconds_sum{stage=\"%s\"} %.9f\n",
+            name,
+            s.total / 1e9
+        );
+        fprintf(
+            fp,
+            "eyes_stage_latency_seconds_count{stage=\"%s\"} %llu\n",
+            name,
+            (unsigned long long) s.count
+        );
+        fprintf(
+            fp,
+            "eyes_stage_latency_max_seconds{stage=\"%s\"} %.9f\n",
+            name,
+            s.max / 1e9
+        );
+    }
+
+    fprintf(fp, "# TYPE eyes_events_total counter\n");
+    for (size_t i = 0; i < counter_names.size(); i++) {
+        fprintf(
+            fp,
+            "eyes_events_total{event=\"%s\"} %llu\n",
+            counter_names[i].c_str(),
+            (unsigned long long) counters[i].load(std::memory_order_relaxed)
+        );
+    }
+
+    fprintf(fp, "# TYPE eyes_gauge gauge\n");
+    for (size_t i = 0; i < gauge_names.size(); i++) {
+        fprintf(
+            fp,
+            "eyes_gauge{name=\"%s\"} %lld\n",
+            gauge_names[i].c_str(),
+            (long long) gauges[i].load(std::memory_order_relaxed)
+        );
+    }
+}
+
+int statsDump(const std::string &path)
+{
+    std::string tmp = path + ".tmp";
+    bool prometheus = path.size() > 5
+        && path.compare(path.size() - 5, 5, ".prom") == 0;
+    FILE *fp = fopen(tmp.c_str(), "w");
+
+    if (fp == NULL) {
+        log_err("Failed to open [%s] for writing!", tmp.c_str());
+        return -1;
+    }
+
+    {
+        std::lock_guard<std::mutex> guard(registry_lock);
+        if (prometheus) {
+            writePrometheus(fp);
+        } else {
+            writeJSON(fp);
+        }
+    }
+    fclose(fp);
+
+    // readers never see a half written file
+    if (rename(tmp.c_str(), path.c_str()) != 0) {
+        log_err("Failed to write stats [%s]!", path.c_str());
+        return -1;
+    }
+
+    return 0;
+}
+
+int statsStart(const std::string &path, double interval_seconds)
+{
+    if (exporter_running) {
+        return 0;
+    }
+
+    // joins the exporter and writes a final dump on any exit path
+    static bool registered = false;
+    if (!registered) {
+        atexit(statsStop);
+        registered = true;
+    }
+
+    stats_enabled = true;
+    exporter_running = true;
+    exporter = std::thread([path, interval_seconds]() {
+        std::chrono::duration<double> interval(interval_seconds);
+        std::unique_lock<std::mutex> lock(exporter_lock);
+
+        while (exporter_running) {
+            exporter_wake.wait_for(lock, interval);
+            statsDump(path);
+        }
+    });
+
+    return 0;
+}
+
+void statsStop()
+{
+    if (!exporter_running) {
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> guard(exporter_lock);
+        exporter_running = false;
+    }
+    exporter_wake.notify_all();
+    exporter.join();
+    stats_enabled = false;
+}
@@ -0,0 +1,340 @@
+#include <stdio.h>
+#include <string.h>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <opencv/highgui.h>
+#include <opencv/cv.h>
+
+#include <dbg/dbg.h>
+
+#include <eyes/calibrationBundle.hpp>
+#include <eyes/disparity.hpp>
+#include <eyes/frameSource.hpp>
+#include <eyes/pixelFormat.hpp>
+#include <eyes/sourceConfig.hpp>
+#include <eyes/stats.hpp>
+#include <eyes/tracking.hpp>
+
+#define FRAME_WIDTH 400
+#define FRAME_HEIGHT 300
+#define TRACKING_WINDOW "Stereo Tracking"
+#define THRESHOLD_WINDOW "Thresholded Image"
+
+// a tracked object and where it is in front of the left camera
+struct object_position
+{
+    struct tracked_object object;
+    cv::Point3f position;       // calibration units, left camera frame
+    float disparity;            // pixels
+    int matches;                // valid disparities in the bounding box
+};
+
+int parseScalar(const char *arg, cv::Scalar &value)
+{
+    int v[3];
+
+    if (sscanf(arg, "%d,%d,%d", &v[0], &v[1], &v[2]) != 3) {
+        log_err("Invalid HSV value [%s], expected h,s,v!", arg);
+        return -1;
+    }
+    value = cv::Scalar(v[0], v[1], v[2]);
+
+    return 0;
+}
+
+void drawPosition(const struct object_position &p, cv::Mat &frame)
+{
+    std::stringstream ss;
+
+    cv::rectangle(frame, p.object.bounds, cv::Scalar(0, 255, 0), 1);
+    drawObject(p.object.centre.x, p.object.centre.y, frame);
+
+    if (p.matches > 0) {
+        ss.precision(2);
+        ss << std::fixed << "z " << p.position.z;
+    } else {
+        ss << "no depth";
+    }
+    cv::putText(
+        frame,
+        ss.str(),
+        p.object.bounds.tl() - cv::Point(0, 5),
+        1,
+        1,
+        cv::Scalar(0, 255, 0),
+        1
+    );
+}
+
+int main(int argc, char* argv[])
+{
+    struct calibration_bundle bundle;
+    struct source_config config;
+    bool configured = false;
+    std::vector<std::string> specs;
+    cv::Scalar hsv_min(0, 100, 100);
+    cv::Scalar hsv_max(10, 256, 256);
+    bool use_morph = true;
+    bool calibrated = false;
+    int status = 0;
+
+    // parse arguments
+    initCalibrationBundle(&bundle);
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--source") == 0 && i + 1 < argc) {
+            specs.push_back(argv[++i]);
+        } else if (strcmp(argv[i], "--config") == 0 && i + 1 < argc) {
+            if (loadSourceConfig(argv[++i], &config) != 0) {
+                log_err("Failed to load source configuration [%s]!", argv[i]);
+                return -1;
+            }
+            configured = true;
+        } else if (strcmp(argv[i], "--stats") == 0 && i + 1 < argc) {
+            statsStart(argv[++i]);
+        } else if (strcmp(argv[i], "--hsv-min") == 0 && i + 1 < argc) {
+            if (parseScalar(argv[++i], hsv_min) != 0) {
+                return -1;
+            }
+        } else if (strcmp(argv[i], "--hsv-max") == 0 && i + 1 < argc) {
+            if (parseScalar(argv[++i], hsv_max) != 0) {
+                return -1;
+            }
+        } else if (strcmp(argv[i], "--no-morph") == 0) {
+            use_morph = false;
+        } else if (strcmp(argv[i], "--calibration") == 0 && i + 1 < argc) {
+            if (loadCalibration(argv[++i], &bundle) != 0) {
+                return -1;
+            } else if ((bundle.flags & BUNDLE_HAS_STEREO) == 0) {
+                log_err("Calibration is not a stereo calibration!");
+                return -1;
+            }
+            calibrated = true;
+        } else {
+            log_err(
+                "Usage: %s --calibration <bundle|xml> "
+                "[--source <spec> --source <spec>] [--config <file>] "
+                "[--hsv-min h,s,v] [--hsv-max h,s,v] [--no-morph] "
+                "[--stats <file>]",
+                argv[0]
+            );
+            return -1;
+        }
+    }
+
+    // depth needs the rectification and disparity to depth matrix
+    if (!calibrated) {
+        log_err("Stereo tracking requires a stereo --calibration!");
+        return -1;
+    }
+
+    // sources given on the command line win over a configuration file,
+    // without either the cameras are enumerated, or taken from the cache
+    // while the same devices are plugged in
+    cv::Size frame_size(FRAME_WIDTH, FRAME_HEIGHT);
+    bool discovered = false;
+
+    if (specs.empty() && configured) {
+        specs = config.specs;
+        if (config.size.area() > 0) {
+            frame_size = config.size;
+        }
+    } else if (specs.empty()) {
+        if (discoverSources(SOURCE_CACHE, frame_size, &config) != 0) {
+            log_err("No cameras found!");
+            return -1;
+        }
+        specs = config.specs;
+        frame_size = config.size;
+        discovered = true;
+    }
+    if (specs.size() < 2) {
+        log_err("Stereo tracking requires 2 sources, got %d!", (int) specs.size());
+        return -1;
+    }
+
+    // only the stereo pair is tracked, further sources of a shared
+    // configuration are not opened
+    if (specs.size() > 2) {
+        log_info("Using the first 2 of %d sources", (int) specs.size());
+        specs.resize(2);
+    }
+
+    // the remap tables only fit frames of the calibrated size, whatever
+    // size the configuration asks for
+    frame_size = bundle.image_size;
+
+    std::vector<cv::Ptr<FrameSource> > sources = openFrameSources(specs, frame_size);
+    cv::Ptr<FrameSource> camera_1 = sources[0];
+    cv::Ptr<FrameSource> camera_2 = sources[1];
+    cv::StereoBM bm = initDisparityCalculator();
+    std::vector<struct tracked_object> objects;
+    Frame frame_1;
+    Frame frame_2;
+    cv::Mat feed_1;
+    cv::Mat feed_2;
+    cv::Mat rect_feed_1;
+    cv::Mat rect_feed_2;
+    cv::Mat gray_feed_1;
+    cv::Mat gray_feed_2;
+    cv::Mat hsv;
+    cv::Mat threshold;
+
+    // check camera feeds, openFrameSources names the ones that failed
+    if (camera_1.empty() || camera_2.empty()) {
+        return -1;
+    }
+
+    // drivers snap to the sizes they support, which may not be the one
+    // the pair was calibrated at
+    for (size_t i = 0; i < 2; i++) {
+        if (sources[i]->size() != bundle.image_size) {
+            log_err(
+                "Source [%s] opened at %dx%d, calibrated size is %dx%d!",
+                specs[i].c_str(),
+                sources[i]->size().width,
+                sources[i]->size().height,
+                bundle.image_size.width,
+                bundle.image_size.height
+            );
+            return -1;
+        }
+    }
+
+    // remember what was discovered, so the next start skips enumeration
+    if (discovered) {
+        config.size = camera_1->size();
+        saveSourceConfig(SOURCE_CACHE, &config);
+    }
+
+    cv::namedWindow(TRACKING_WINDOW, CV_WINDOW_AUTOSIZE);
+    cv::namedWindow(THRESHOLD_WINDOW, CV_WINDOW_AUTOSIZE);
+
+    while (1) {
+        std::vector<struct object_position> positions;
+        int found;
+        STATS_SCOPE("frame");
+
+        // read video streams
+        {
+            STATS_SCOPE("capture");
+            if (!camera_1->read(frame_1) || !camera_2->read(frame_2)) {
+                break;
+            }
+        }
+        STATS_COUNT("frames", 1);
+
+        // track in rectified coordinates, so the bounding boxes line up with
+        // the rows of the right image
+        frameToBGR(frame_1, feed_1);
+        frameToBGR(frame_2, feed_2);
+        {
+            STATS_SCOPE("remap");
+            if (rectifyFrame(&bundle, 0, feed_1, rect_feed_1) != 0
+                    || rectifyFrame(&bundle, 1, feed_2, rect_feed_2) != 0) {
+                status = -1;
+                break;
+            }
+        }
+
+        // colour pipeline on the left image
+        {
+            STATS_SCOPE("hsv_convert");
+            cvtColor(rect_feed_1, hsv, cv::COLOR_BGR2HSV);
+        }
+        {
+            STATS_SCOPE("threshold");
+            inRange(hsv, hsv_min, hsv_max, threshold);
+        }
+        if (use_morph) {
+            morphOps(threshold);
+        }
+        found = findFilteredObjects(threshold, objects);
+
+        // disparity inside the objects only
+        if (found > 0) {
+            {
+                STATS_SCOPE("gray_convert");
+                cvtColor(rect_feed_1, gray_feed_1, CV_BGR2GRAY);
+                cvtColor(rect_feed_2, gray_feed_2, CV_BGR2GRAY);
+            }
+
+            for (size_t i = 0; i < objects.size(); i++) {
+                struct object_position p;
+
+                p.object = objects[i];
+                p.disparity = 0.0f;
+                p.matches = calculateRoiDisparity(
+                    bm,
+                    gray_feed_1,
+                    gray_feed_2,
+                    objects[i].bounds,
+                    p.disparity
+                );
+                if (p.matches > 0 && p.disparity > 0.0f) {
+                    p.position = disparityToPoint(
+                        bundle.disparity_to_depth,
+                        objects[i].centre,
+                        p.disparity
+                    );
+                } else {
+                    p.matches = 0;
+                }
+                positions.push_back(p);
+            }
+        }
+        STATS_COUNT("objects", positions.size());
+
+        // report objects, x and y in rectified left image pixels
+        for (size_t i = 0; i < positions.size(); i++) {
+            const struct object_position &p = positions[i];
+
+            if (p.matches > 0) {
+                printf(
+                    "%llu %zu %.1f %.1f %.3f\n",
+                    (unsigned long long) frame_1.sequence,
+                    i,
+                    p.object.centre.x,
+                    p.object.centre.y,
+                    p.position.z
+                );
+            } else {
+                printf(
+                    "%llu %zu %.1f %.1f nan\n",
+                    (unsigned long long) frame_1.sequence,
+                    i,
+                    p.object.centre.x,
+                    p.object.centre.y
+                );
+            }
+            drawPosition(p, rect_feed_1);
+        }
+        fflush(stdout);
+
+        if (found < 0) {
+            cv::putText(
+                rect_feed_1,
+                "TOO MUCH NOISE! ADJUST FILTER",
+                cv::Point(0, 50),
+                1,
+                2,
+                cv::Scalar(0, 0, 255),
+                2
+            );
+        }
+
+        // display
+        {
+            STATS_SCOPE("display");
+            cv::imshow(TRACKING_WINDOW, rect_feed_1);
+            cv::imshow(THRESHOLD_WINDOW, threshold);
+        }
+        STATS_SCOPE("wait_key");
+        cv::waitKey(30);
+    }
+    statsStop();
+    releaseCalibrationBundle(&bundle);
+
+    return status;
+}
@@ -1,13 +1,27 @@
+#include <algorithm>
 #include <iostream>
+#include <sstream>
 #include <string>
+#include <string.h>
 
 #include <opencv/highgui.h>
 #include <opencv/cv.h>
 
 #include <dbg/dbg.h>
 
+#include <eyes/calibrationBundle.hpp>
+#include <eyes/disparity.hpp>
+#include <eyes/frameSource.hpp>
+#include <eyes/motionGate.hpp>
+#include <eyes/pixelFormat.hpp>
+#include <eyes/recording.hpp>
+#include <eyes/sourceConfig.hpp>
+#include <eyes/stats.hpp>
+#include <eyes/videoRecorder.hpp>
+
 #define FRAME_WIDTH 400
 #define FRAME_HEIGHT 300
+#define OUTPUT_FPS 30.0
 #define CAM_1 "Camera 1"
 #define CAM_2 "Camera 2"
 #define DISPARITY_MAP "Disparity Map"
@@ -18,32 +32,6 @@ struct DisparityEventData
     int *type;
 };
 
-int detectNumberOfCameras()
-{
-    int num = 0;
-    int finished = 0;
-
-    while(finished == false) {
-        CvCapture* capture = cvCreateCameraCapture(num);
-
-        if (!capture) {
-            finished = 1;
-        } else {
-            num++;
-            cvReleaseCapture(&capture);
-        }
-    }
-
-    // check result
-    std::cout << "Number of cameras: " << num << std::endl;
-    if (num != 2) {
-        std::cout << "Failed to detect 2 cameras for stereo vision!" << std::endl;
-        exit(-1);
-    }
-
-    return num;
-}
-
 void sadWindowSizeEvent(int pos, void *sad_winsize) {
     if (pos > 5 && pos < 255 && pos % 2 != 0)
         *(int *)sad_winsize = pos;
@@ -240,82 +228,330 @@ cv::string getImgType(int imgTypeInt)
     return "unknown image type";
 }
 
-cv::StereoBM initDisparityCalculator() {
-    cv::StereoBM bm(CV_STEREO_BM_BASIC);
-
-    bm.state->SADWindowSize = 5;
-    bm.state->numberOfDisparities = 96;
-    bm.state->preFilterSize = 25;
-    bm.state->preFilterCap = 63;
-    bm.state->minDisparity = 0;
-    bm.state->textureThreshold = 20;
-    bm.state->uniquenessRatio = 10;
-    bm.state->speckleWindowSize = 25;
-    bm.state->speckleRange = 32;
-    bm.state->disp12MaxDiff = 1;
-
-    return bm;
+bool disparityConfigChanged(cv::StereoBM &bm, std::vector<int> &config)
+{
+    std::vector<int> current;
+
+    current.push_back(bm.state->SADWindowSize);
+    current.push_back(bm.state->numberOfDisparities);
+    current.push_back(bm.state->preFilterSize);
+    current.push_back(bm.state->preFilterCap);
+    current.push_back(bm.state->minDisparity);
+    current.push_back(bm.state->textureThreshold);
+    current.push_back(bm.state->uniquenessRatio);
+    current.push_back(bm.state->speckleWindowSize);
+    current.push_back(bm.state->speckleRange);
+    current.push_back(bm.state->disp12MaxDiff);
+
+    if (current == config) {
+        return false;
+    }
+    config = current;
+    return true;
 }
 
-cv::Mat calculateDisparity(
-    cv::StereoBM bm,
-    cv::Mat left,
-    cv::Mat right)
+// Recomputes the disparity rows under changed tiles of either camera and
+// returns the number of rows recomputed. The map is copied before it is
+// updated, so maps handed out earlier (e.g. queued for encoding) keep their
+// contents.
+int updateDisparity(
+    cv::StereoBM &bm,
+    cv::Mat &left,
+    cv::Mat &right,
+    MotionGate &gate_1,
+    MotionGate &gate_2,
+    cv::Mat &disparity_map)
 {
-    cv::Size size = left.size();
-    cv::Mat disparity_map = cv::Mat(size, CV_16SC1);
-    cv::Mat left_converted;
-    cv::Mat right_converted;
+    std::vector<cv::Range> bands;
+    int rows = 0;
 
-    // calculate disparity map
-    bm(left, right, disparity_map);
+    for (int row = 0; row < gate_1.gridSize().height; row++) {
+        cv::Rect tile = gate_1.tileRect(0, row);
 
-    return disparity_map;
+        if (!gate_1.rowChanged(row) && !gate_2.rowChanged(row)) {
+            continue;
+        }
+
+        // extend the previous band when the rows are adjacent
+        if (!bands.empty() && bands.back().end == tile.y) {
+            bands.back().end = tile.y + tile.height;
+        } else {
+            bands.push_back(cv::Range(tile.y, tile.y + tile.height));
+        }
+    }
+    if (bands.empty()) {
+        return 0;
+    }
+
+    // tiles map back onto the frame to within a downscaled pixel
+    disparity_map = disparity_map.clone();
+    for (size_t i = 0; i < bands.size(); i++) {
+        cv::Range band(
+            std::max(bands[i].start - MOTION_SCALE, 0),
+            std::min(bands[i].end + MOTION_SCALE, left.rows)
+        );
+
+        calculateDisparityRows(bm, left, right, band, disparity_map);
+        rows += band.size();
+    }
+
+    return rows;
 }
 
 int main(int argc, char* argv[])
 {
-    int num_cams = detectNumberOfCameras();
-    cv::VideoCapture camera_1(0);
-    cv::VideoCapture camera_2(1);
+    struct calibration_bundle bundle;
+    struct source_config config;
+    bool rectify = false;
+    bool configured = false;
+    std::vector<std::string> specs;
+    cv::Ptr<FrameRecorder> recorder;
+    cv::Ptr<VideoRecorder> disparity_recorder;
+    const char *record_path = NULL;
+    const char *disparity_path = NULL;
+    std::string drop_policy = "oldest";
+    bool motion_gate = false;
+    int status = 0;
+
+    // parse arguments, load stereo calibration with remap tables
+    // precomputed in the bundle
+    initCalibrationBundle(&bundle);
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--source") == 0 && i + 1 < argc) {
+            specs.push_back(argv[++i]);
+        } else if (strcmp(argv[i], "--config") == 0 && i + 1 < argc) {
+            if (loadSourceConfig(argv[++i], &config) != 0) {
+                log_err("Failed to load source configuration [%s]!", argv[i]);
+                return -1;
+            }
+            configured = true;
+        } else if (strcmp(argv[i], "--stats") == 0 && i + 1 < argc) {
+            statsStart(argv[++i]);
+        } else if (strcmp(argv[i], "--record") == 0 && i + 1 < argc) {
+            record_path = argv[++i];
+        } else if (strcmp(argv[i], "--motion-gate") == 0) {
+            motion_gate = true;
+        } else if (strcmp(argv[i], "--record-disparity") == 0 && i + 1 < argc) {
+            disparity_path = argv[++i];
+        } else if (strcmp(argv[i], "--record-policy") == 0 && i + 1 < argc) {
+            drop_policy = argv[++i];
+        } else if (strcmp(argv[i], "--calibration") == 0 && i + 1 < argc) {
+            if (loadCalibration(argv[++i], &bundle) != 0) {
+                return -1;
+            } else if ((bundle.flags & BUNDLE_HAS_STEREO) == 0) {
+                log_err("Calibration is not a stereo calibration!");
+                return -1;
+            }
+            rectify = true;
+        } else {
+            log_err(
+                "Usage: %s [--source <spec> --source <spec> ...] "
+                "[--config <file>] "
+                "[--calibration <bundle|xml>] [--stats <file>] [--motion-gate] "
+                "[--record <file>] [--record-disparity <file>] "
+                "[--record-policy oldest|newest]",
+                argv[0]
+            );
+            return -1;
+        }
+    }
+
+    // encode disparity maps in the background
+    if (disparity_path) {
+        disparity_recorder = new VideoRecorder(
+            "disparity",
+            disparity_path,
+            OUTPUT_FPS,
+            parseDropPolicy(drop_policy)
+        );
+    }
+
+    // sources given on the command line win over a configuration file,
+    // without either the cameras are enumerated, or taken from the cache
+    // while the same devices are plugged in
+    cv::Size frame_size(FRAME_WIDTH, FRAME_HEIGHT);
+    bool discovered = false;
+
+    if (specs.empty() && configured) {
+        specs = config.specs;
+        if (config.size.area() > 0) {
+            frame_size = config.size;
+        }
+    } else if (specs.empty()) {
+        if (discoverSources(SOURCE_CACHE, frame_size, &config) != 0) {
+            log_err("No cameras found!");
+            return -1;
+        }
+        specs = config.specs;
+        frame_size = config.size;
+        discovered = true;
+    }
+    if (specs.size() < 2) {
+        log_err("Stereo vision requires at least 2 sources, got %d!", (int) specs.size());
+        return -1;
+    }
+
+    // the remap tables only fit frames of the calibrated size
+    if (rectify) {
+        frame_size = bundle.image_size;
+    }
+
+    // the first two sources are the stereo pair, any others are recorded
+    // and displayed alongside
+    std::vector<cv::Ptr<FrameSource> > sources = openFrameSources(specs, frame_size);
+    std::vector<Frame> frames(sources.size());
+    Frame frame_1;
+    Frame frame_2;
     cv::Mat feed_1;
     cv::Mat feed_2;
     cv::Mat gray_feed_1;
     cv::Mat gray_feed_2;
+    cv::Mat rect_feed_1;
+    cv::Mat rect_feed_2;
+    cv::Mat extra_feed;
     cv::Size size = feed_1.size();
     cv::Mat disparity_map = cv::Mat(size, CV_16SC1);
     cv::StereoBM bm = initDisparityCalculator();
+    std::vector<int> bm_config;
+    std::vector<std::string> windows;
+    MotionGate gate_1;
+    MotionGate gate_2;
+
+    // check camera feeds, openFrameSources names the ones that failed
+    for (size_t i = 0; i < sources.size(); i++) {
+        if (sources[i].empty()) {
+            return -1;
+        }
+    }
 
-    // check camera feeds
-    if (!camera_1.isOpened() && !camera_2.isOpened()) {
-        std::cout << "Failed to open video feeds!" << std::endl;
-        return -1;
+    // drivers snap to the sizes they support, which may not be the one
+    // the pair was calibrated at
+    for (size_t i = 0; rectify && i < 2; i++) {
+        if (sources[i]->size() != bundle.image_size) {
+            log_err(
+                "Source [%s] opened at %dx%d, calibrated size is %dx%d!",
+                specs[i].c_str(),
+                sources[i]->size().width,
+                sources[i]->size().height,
+                bundle.image_size.width,
+                bundle.image_size.height
+            );
+            return -1;
+        }
+    }
+
+    // remember what was discovered, so the next start skips enumeration
+    if (discovered) {
+        config.size = sources[0]->size();
+        saveSourceConfig(SOURCE_CACHE, &config);
+    }
+
+    if (record_path) {
+        recorder = new FrameRecorder(record_path, sources.size());
+        if (!recorder->isOpened()) {
+            return -1;
+        }
     }
 
     // create gui windows
-    cv::namedWindow(CAM_1, CV_WINDOW_AUTOSIZE);
-    cv::namedWindow(CAM_2, CV_WINDOW_AUTOSIZE);
+    windows.push_back(CAM_1);
+    windows.push_back(CAM_2);
+    for (size_t i = 2; i < sources.size(); i++) {
+        std::stringstream ss;
+        ss << "Camera " << i + 1;
+        windows.push_back(ss.str());
+    }
+    for (size_t i = 0; i < windows.size(); i++) {
+        cv::namedWindow(windows[i], CV_WINDOW_AUTOSIZE);
+    }
     cv::namedWindow(DISPARITY_MAP, CV_WINDOW_AUTOSIZE);
     initDisparityConfigurator(bm);
 
     while(1) {
+        bool captured = true;
+        STATS_SCOPE("frame");
+
         // read video streams
-        camera_1 >> feed_1;
-        camera_2 >> feed_2;
-        cvtColor(feed_1, gray_feed_1, CV_BGR2GRAY);
-        cvtColor(feed_2, gray_feed_2, CV_BGR2GRAY);
+        {
+            STATS_SCOPE("capture");
+            for (size_t i = 0; i < sources.size() && captured; i++) {
+                captured = sources[i]->read(frames[i]);
+            }
+        }
+        if (!captured) {
+            break;
+        }
+        STATS_COUNT("frames", 1);
+        if (!recorder.empty()) {
+            recorder->record(frames);
+        }
+        frame_1 = frames[0];
+        frame_2 = frames[1];
+
+        // native capture formats go straight to their Y plane and are only
+        // displayed in grey
+        frameToGray(frame_1, gray_feed_1);
+        frameToGray(frame_2, gray_feed_2);
+        feed_1 = frame_1.format == FORMAT_BGR ? frame_1.image : gray_feed_1;
+        feed_2 = frame_2.format == FORMAT_BGR ? frame_2.image : gray_feed_2;
+
+        // rectify stereo pair
+        if (rectify) {
+            STATS_SCOPE("remap");
+            if (rectifyFrame(&bundle, 0, gray_feed_1, rect_feed_1) != 0
+                    || rectifyFrame(&bundle, 1, gray_feed_2, rect_feed_2) != 0) {
+                status = -1;
+                break;
+            }
+        } else {
+            rect_feed_1 = gray_feed_1;
+            rect_feed_2 = gray_feed_2;
+        }
 
-        // display camera feeds
-        cv::imshow(CAM_1, feed_1);
-        cv::imshow(CAM_2, feed_2);
+        // calculate disparity map, with the motion gate only for the rows
+        // that changed since they were last matched
+        if (motion_gate) {
+            if (disparityConfigChanged(bm, bm_config)
+                    || disparity_map.size() != rect_feed_1.size()) {
+                disparity_map = cv::Mat::zeros(rect_feed_1.size(), CV_16SC1);
+                gate_1.invalidate();
+                gate_2.invalidate();
+            }
+            gate_1.update(rect_feed_1);
+            gate_2.update(rect_feed_2);
+
+            if (updateDisparity(bm, rect_feed_1, rect_feed_2,
+                    gate_1, gate_2, disparity_map) == 0) {
+                STATS_COUNT("frames_skipped", 1);
+            }
+        } else {
+            disparity_map = calculateDisparity(bm, rect_feed_1, rect_feed_2);
+        }
+        if (!disparity_recorder.empty()) {
+            disparity_recorder->write(disparity_map);
+        }
 
-        // calculate and display disparity map
-        disparity_map = calculateDisparity(bm, gray_feed_1, gray_feed_2);
-        cv::imshow(DISPARITY_MAP, disparity_map);
+        // display camera feeds and disparity map
+        {
+            STATS_SCOPE("display");
+            cv::imshow(CAM_1, feed_1);
+            cv::imshow(CAM_2, feed_2);
+            for (size_t i = 2; i < frames.size(); i++) {
+                if (frames[i].format == FORMAT_BGR) {
+                    cv::imshow(windows[i], frames[i].image);
+                } else {
+                    frameToGray(frames[i], extra_feed);
+                    cv::imshow(windows[i], extra_feed);
+                }
+            }
+            cv::imshow(DISPARITY_MAP, disparity_map);
+        }
 
 		// delay 30ms so that screen can refresh.
+        STATS_SCOPE("wait_key");
         cv::waitKey(30);  // IMPORTANT!! IMAGE WILL NOT DISPLAY WITHOUT IT!
     }
+    statsStop();
 
-    return 0;
+    return status;
 }
@@ -0,0 +1,322 @@
+#include <sstream>
+#include <string>
+
+#include <opencv2/core/core.hpp>
+#include <opencv2/imgproc/imgproc.hpp>
+
+#include <eyes/stats.hpp>
+#include <eyes/tracking.hpp>
+
+using namespace cv;
+using namespace std;
+
+string intToString(int number) {
+	std::stringstream ss;
+	ss << number;
+	return ss.str();
+}
+
+struct tracking_limits trackingLimits(Size resolution) {
+	struct tracking_limits limits;
+	double scale = (double) resolution.area() / (TRACKING_WIDTH * TRACKING_HEIGHT);
+
+	// noise floor grows with the pixel count, the upper limit stays at
+	// 2/3 of the frame
+	limits.min_area = MIN_OBJECT_AREA * scale;
+	limits.max_area = resolution.area() / 1.5;
+	return limits;
+}
+
+int pyramidLevels(Size resolution) {
+	int levels = 0;
+
+	while ((resolution.width >> levels) > PYRAMID_MAX_WIDTH) {
+		levels++;
+	}
+	return levels;
+}
+
+void drawObject(int x, int y,Mat &frame){
+	// draw crossairs on tracked objects
+	circle(frame,Point(x, y),20,Scalar(0,255,0),2);
+	line(frame,Point(x, y - 5), Point(x, y - 25), Scalar(0, 255, 0), 2);
+	line(frame,Point(x, y + 5), Point(x, y + 25), Scalar(0, 255, 0), 2);
+	line(frame,Point(x - 5, y), Point(x - 25, y), Scalar(0, 255, 0), 2);
+	line(frame,Point(x + 5, y), Point(x + 25, y), Scalar(0, 255, 0), 2);
+
+	putText(
+		frame,
+		intToString(x) + "," + intToString(y),
+		Point(x, y + 30),
+		1,
+		1,
+		Scalar(0, 255, 0),
+        2
+	);
+}
+
+void morphOps(Mat &thresh){
+	STATS_SCOPE("morphology");
+
+	//create structuring element that will be used to "dilate" and "erode" image.
+	//the element chosen here is a 3px by 3px rectangle
+    Mat erodeElement = getStructuringElement(MORPH_RECT, Size(3, 3));
+
+    //dilate with larger element so make sure object is nicely visible
+    Mat dilateElement = getStructuringElement(MORPH_RECT, Size(8, 8));
+
+	erode(thresh, thresh,erodeElement);
+	erode(thresh, thresh,erodeElement);
+
+	dilate(thresh, thresh,dilateElement);
+	dilate(thresh, thresh,dilateElement);
+}
+
+void drawTrackingStatus(int status, int x, int y, Mat &cameraFeed) {
+	// headless runs have no feed to draw on
+	if (cameraFeed.empty())
+		return;
+
+	//let user know you found an object
+	if (status == TRACKING_FOUND) {
+		putText(cameraFeed,
+			"Tracking Object",
+			Point(0, 50),
+			2,
+			1,
+			Scalar(0, 255, 0),
+			2
+		);
+		drawObject(x, y, cameraFeed);
+	} else if (status == TRACKING_NOISE) {
+		putText(cameraFeed,
+			"TOO MUCH NOISE! ADJUST FILTER",
+			Point(0,50),
+			1,
+			2,
+			Scalar(0,0,255),
+			2
+		);
+	}
+}
+
+int trackFilteredObject(int &x, int &y, Mat threshold, Mat &cameraFeed) {
+	Mat temp;
+	vector<vector<Point> > contours;
+	vector<Vec4i> hierarchy;
+	double refArea = 0;
+	bool objectFound = false;
+	int status = TRACKING_NONE;
+	struct tracking_limits limits = trackingLimits(threshold.size());
+	STATS_SCOPE("contours");
+
+	threshold.copyTo(temp);
+
+	// these two vectors needed for output of findContours
+	// find contours of filtered image using openCV findContours function
+	findContours(temp, contours, hierarchy, CV_RETR_CCOMP, CV_CHAIN_APPROX_SIMPLE);
+	// use moments method to find our filtered object
+	if (hierarchy.size() > 0) {
+		int numObjects = hierarchy.size();
+
+		//if number of objects greater than MAX_NUM_OBJECTS we have a noisy filter
+		if (numObjects<MAX_NUM_OBJECTS) {
+			for (int index = 0; index >= 0; index = hierarchy[index][0]) {
+				Moments moment = moments((cv::Mat)contours[index]);
+				double area = moment.m00;
+
+				// if the area is less than 20 px by 20px then it is probably just noise
+				// if the area is the same as the 3/2 of the image size, probably just a bad filter
+				// we only want the object with the largest area so we safe a reference area each
+				// iteration and compare it to the area in the next iteration.
+				if (area>limits.min_area && area<limits.max_area && area>refArea) {
+					x = moment.m10 / area;
+					y = moment.m01 / area;
+					objectFound = true;
+				} else {
+					objectFound = false;
+				}
+			}
+			if (objectFound == true)
+				status = TRACKING_FOUND;
+		} else {
+			status = TRACKING_NOISE;
+		}
+	}
+
+	drawTrackingStatus(status, x, y, cameraFeed);
+	return status;
+}
+
+int findFilteredObjects(const Mat &threshold, vector<struct tracked_object> &objects) {
+	Mat temp;
+	vector<vector<Point> > contours;
+	struct tracking_limits limits = trackingLimits(threshold.size());
+	STATS_SCOPE("contours");
+
+	objects.clear();
+	threshold.copyTo(temp);
+	findContours(temp, contours, CV_RETR_EXTERNAL, CV_CHAIN_APPROX_SIMPLE);
+	if (contours.size() >= (size_t) MAX_NUM_OBJECTS) {
+		return -1;
+	}
+
+	for (size_t i = 0; i < contours.size(); i++) {
+		struct tracked_object object;
+		Moments moment = moments((cv::Mat) contours[i]);
+
+		if (moment.m00 <= limits.min_area || moment.m00 >= limits.max_area) {
+			continue;
+		}
+
+		object.centre = Point2f(moment.m10 / moment.m00, moment.m01 / moment.m00);
+		object.bounds = boundingRect(contours[i]);
+		object.area = moment.m00;
+		objects.push_back(object);
+	}
+
+	return objects.size();
+}
+
+void thresholdRegions(
+	const Mat &frame,
+	const vector<Rect> &regions,
+	Scalar hsv_min,
+	Scalar hsv_max,
+	bool use_morph,
+	Mat &hsv,
+	Mat &threshold)
+{
+	Rect bounds(0, 0, frame.cols, frame.rows);
+	vector<Rect> stale = regions;
+	int reach = use_morph ? MORPH_REACH : 0;
+	STATS_SCOPE("threshold_regions");
+
+	if (hsv.size() != frame.size() || hsv.type() != CV_8UC3
+			|| threshold.size() != frame.size() || threshold.type() != CV_8UC1) {
+		hsv.create(frame.size(), CV_8UC3);
+		threshold.create(frame.size(), CV_8UC1);
+		stale.assign(1, bounds);
+	}
+
+	for (size_t i = 0; i < stale.size(); i++) {
+		Rect output = stale[i] & bounds;
+		Mat patch_hsv;
+		Mat patch_thresh;
+
+		// morphOps needs the pixels around the output to get its border
+		// right, and has to run on a patch of its own or it would read the
+		// already processed threshold around it
+		Rect input = Rect(
+			output.x - reach,
+			output.y - reach,
+			output.width + 2 * reach,
+			output.height + 2 * reach
+		) & bounds;
+		Rect inner = output - input.tl();
+
+		cvtColor(frame(input), patch_hsv, COLOR_BGR2HSV);
+		inRange(patch_hsv, hsv_min, hsv_max, patch_thresh);
+		if (use_morph) {
+			morphOps(patch_thresh);
+		}
+
+		patch_hsv(inner).copyTo(hsv(output));
+		patch_thresh(inner).copyTo(threshold(output));
+	}
+}
+
+int trackPyramid(
+	const Mat &frame,
+	Scalar hsv_min,
+	Scalar hsv_max,
+	bool use_morph,
+	vector<struct tracked_object> &objects,
+	Mat *level_threshold)
+{
+	int levels = pyramidLevels(frame.size());
+	int scale = 1 << levels;
+	struct tracking_limits level_limits;
+	struct tracking_limits limits = trackingLimits(frame.size());
+	vector<vector<Point> > contours;
+	Mat level;
+	Mat hsv;
+	Mat thresh;
+	STATS_SCOPE("pyramid_track");
+
+	objects.clear();
+
+	// detect on the downscaled level
+	{
+		STATS_SCOPE("pyramid_detect");
+		if (levels > 0) {
+			resize(frame, level, Size(), 1.0 / scale, 1.0 / scale, INTER_AREA);
+		} else {
+			level = frame;
+		}
+		level_limits = trackingLimits(level.size());
+
+		cvtColor(level, hsv, COLOR_BGR2HSV);
+		inRange(hsv, hsv_min, hsv_max, thresh);
+		if (use_morph) {
+			morphOps(thresh);
+		}
+		if (level_threshold) {
+			thresh.copyTo(*level_threshold);
+		}
+
+		findContours(thresh, contours, CV_RETR_EXTERNAL, CV_CHAIN_APPROX_SIMPLE);
+		if (contours.size() >= (size_t) MAX_NUM_OBJECTS) {
+			return -1;
+		}
+	}
+
+	// refine candidates in full resolution patches
+	STATS_SCOPE("pyramid_refine");
+	for (size_t i = 0; i < contours.size(); i++) {
+		struct tracked_object object;
+		double level_area = contourArea(contours[i]);
+		Rect candidate = boundingRect(contours[i]);
+		Rect patch;
+		Mat patch_hsv;
+		Mat patch_thresh;
+		Moments moment;
+		vector<Point> points;
+
+		// allow for blobs that only just drop below the limit when downscaled
+		if (level_area * 2 < level_limits.min_area
+				|| level_area > level_limits.max_area) {
+			continue;
+		}
+
+		// scale up and pad by one level pixel on each side
+		patch = Rect(
+			(candidate.x - 1) * scale,
+			(candidate.y - 1) * scale,
+			(candidate.width + 2) * scale,
+			(candidate.height + 2) * scale
+		) & Rect(0, 0, frame.cols, frame.rows);
+
+		cvtColor(frame(patch), patch_hsv, COLOR_BGR2HSV);
+		inRange(patch_hsv, hsv_min, hsv_max, patch_thresh);
+		if (use_morph) {
+			morphOps(patch_thresh);
+		}
+
+		moment = moments(patch_thresh, true);
+		if (moment.m00 < limits.min_area || moment.m00 > limits.max_area) {
+			continue;
+		}
+
+		object.centre = Point2f(
+			patch.x + moment.m10 / moment.m00,
+			patch.y + moment.m01 / moment.m00
+		);
+		findNonZero(patch_thresh, points);
+		object.bounds = boundingRect(points) + patch.tl();
+		object.area = moment.m00;
+		objects.push_back(object);
+	}
+
+	return objects.size();
+}
@@ -0,0 +1,134 @@
+#include <dbg/dbg.h>
+
+#include <eyes/pixelFormat.hpp>
+#include <eyes/stats.hpp>
+#include <eyes/videoRecorder.hpp>
+
+VideoRecorder::VideoRecorder(
+    const std::string &name,
+    const std::string &path,
+    double fps,
+    enum queue_drop_policy policy,
+    size_t queue_capacity)
+    : name(name),
+      path(path),
+      fps(fps),
+      queue(queue_capacity, policy),
+      frames_written(0),
+      running(true)
+{
+    queue_gauge = statsRegisterGauge(("output_queue_" + name).c_str());
+    drop_counter = statsRegisterCounter(("output_dropped_" + name).c_str());
+    encoder = std::thread(&VideoRecorder::encodeFrames, this);
+}
+
+VideoRecorder::~VideoRecorder()
+{
+    close();
+}
+
+bool VideoRecorder::write(const Frame &frame)
+{
+    uint64_t before = queue.dropped();
+    bool queued = queue.push(frame);
+
+    // with drop oldest a frame can be dropped even though this one queued
+    if (stats_enabled.load(std::memory_order_relaxed)) {
+        statsCount(drop_counter, queue.dropped() - before);
+        statsGauge(queue_gauge, queue.size());
+    }
+
+    return queued;
+}
+
+bool VideoRecorder::write(const cv::Mat &image)
+{
+    Frame frame;
+    frame.image = image;
+    return write(frame);
+}
+
+void VideoRecorder::close()
+{
+    if (!running) {
+        return;
+    }
+
+    queue.close();
+    encoder.join();
+    running = false;
+    writer.release();
+
+    log_info(
+        "Recorded %llu frames to [%s], dropped %llu",
+        (unsigned long long) frames_written.load(),
+        path.c_str(),
+        (unsigned long long) queue.dropped()
+    );
+}
+
+size_t VideoRecorder::queueDepth() const
+{
+    return queue.size();
+}
+
+uint64_t VideoRecorder::dropped() const
+{
+    return queue.dropped();
+}
+
+uint64_t VideoRecorder::written() const
+{
+    return frames_written.load();
+}
+
+void VideoRecorder::encodeFrames()
+{
+    Frame frame;
+    cv::Mat scaled;
+    bool failed = false;
+
+    while (queue.pop(frame)) {
+        STATS_SCOPE("output_encode");
+        cv::Mat image;
+
+        // decode native capture formats, scale disparity maps and other
+        // non 8-bit output
+        frameToBGR(frame, image);
+        if (image.depth() != CV_8U) {
+            cv::normalize(image, scaled, 0, 255, cv::NORM_MINMAX, CV_8U);
+            image = scaled;
+        }
+
+        if (failed) {
+            continue;
+        } else if (!writer.isOpened()) {
+            writer.open(
+                path,
+                CV_FOURCC('M', 'J', 'P', 'G'),
+                fps,
+                image.size(),
+                image.channels() != 1
+            );
+            if (!writer.isOpened()) {
+                log_err("Failed to open video writer [%s]!", path.c_str());
+                failed = true;
+                continue;
+            }
+        }
+
+        writer << image;
+        frames_written++;
+        frame = Frame();
+    }
+}
+
+enum queue_drop_policy parseDropPolicy(const std::string &policy)
+{
+    if (policy == "newest") {
+        return DROP_NEWEST;
+    } else if (policy != "oldest") {
+        log_warn("Unknown drop policy [%s], dropping oldest", policy.c_str());
+    }
+    return DROP_OLDEST;
+}
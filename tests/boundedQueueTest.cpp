@@ -0,0 +1,151 @@
+#include <thread>
+#include <vector>
+
+#include <eyes/boundedQueue.hpp>
+
+#include "test.hpp"
+
+
+// TESTS
+int testDropNewest()
+{
+    BoundedQueue<int> queue(3, DROP_NEWEST);
+    int item;
+
+    for (int i = 0; i < 3; i++) {
+        TEST_CHECK(queue.push(i));
+    }
+
+    // a full queue keeps what it has and refuses the new item
+    TEST_CHECK(!queue.push(3));
+    TEST_CHECK(!queue.push(4));
+    TEST_CHECK(queue.size() == 3);
+    TEST_CHECK(queue.dropped() == 2);
+
+    for (int i = 0; i < 3; i++) {
+        TEST_CHECK(queue.pop(item));
+        TEST_CHECK(item == i);
+    }
+    TEST_CHECK(queue.size() == 0);
+
+    return 0;
+}
+
+int testDropOldest()
+{
+    BoundedQueue<int> queue(3, DROP_OLDEST);
+    int item;
+
+    for (int i = 0; i < 5; i++) {
+        TEST_CHECK(queue.push(i));
+    }
+
+    // the newest items survive, in order
+    TEST_CHECK(queue.size() == 3);
+    TEST_CHECK(queue.dropped() == 2);
+    for (int i = 2; i < 5; i++) {
+        TEST_CHECK(queue.pop(item));
+        TEST_CHECK(item == i);
+    }
+
+    return 0;
+}
+
+int testZeroCapacity()
+{
+    BoundedQueue<int> newest(0, DROP_NEWEST);
+    BoundedQueue<int> oldest(0, DROP_OLDEST);
+
+    TEST_CHECK(!newest.push(1));
+    TEST_CHECK(!oldest.push(1));
+    TEST_CHECK(newest.dropped() == 1);
+    TEST_CHECK(oldest.dropped() == 1);
+    TEST_CHECK(oldest.size() == 0);
+
+    return 0;
+}
+
+int testClose()
+{
+    BoundedQueue<int> queue(4);
+    int item;
+
+    TEST_CHECK(queue.push(1));
+    TEST_CHECK(queue.push(2));
+    queue.close();
+
+    // closed queues refuse new items but drain the queued ones
+    TEST_CHECK(!queue.push(3));
+    TEST_CHECK(queue.dropped() == 1);
+    TEST_CHECK(queue.pop(item) && item == 1);
+    TEST_CHECK(queue.pop(item) && item == 2);
+    TEST_CHECK(!queue.pop(item));
+
+    return 0;
+}
+
+int testWouldDrop()
+{
+    BoundedQueue<int> newest(2, DROP_NEWEST);
+    BoundedQueue<int> oldest(2, DROP_OLDEST);
+
+    for (int i = 0; i < 2; i++) {
+        TEST_CHECK(!newest.wouldDrop());
+        TEST_CHECK(newest.push(i));
+        TEST_CHECK(oldest.push(i));
+    }
+
+    // only a full drop newest queue refuses the next item
+    TEST_CHECK(newest.wouldDrop());
+    TEST_CHECK(!oldest.wouldDrop());
+    newest.drop();
+    TEST_CHECK(newest.dropped() == 1);
+    TEST_CHECK(newest.size() == 2);
+
+    oldest.close();
+    TEST_CHECK(oldest.wouldDrop());
+
+    return 0;
+}
+
+int testConsumerThread()
+{
+    BoundedQueue<int> queue(1024, DROP_NEWEST);
+    std::vector<int> received;
+    std::thread consumer([&queue, &received]() {
+        int item;
+
+        while (queue.pop(item)) {
+            received.push_back(item);
+        }
+    });
+
+    for (int i = 0; i < 1000; i++) {
+        queue.push(i);
+    }
+    queue.close();
+    consumer.join();
+
+    // nothing is lost or reordered while the queue has room
+    TEST_CHECK(queue.dropped() == 0);
+    TEST_CHECK(received.size() == 1000);
+    for (int i = 0; i < 1000; i++) {
+        TEST_CHECK(received[i] == i);
+    }
+
+    return 0;
+}
+
+int main()
+{
+    int failures = 0;
+
+    TEST_RUN(testDropNewest);
+    TEST_RUN(testDropOldest);
+    TEST_RUN(testZeroCapacity);
+    TEST_RUN(testClose);
+    TEST_RUN(testWouldDrop);
+    TEST_RUN(testConsumerThread);
+
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,327 @@
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+#include <opencv2/core/core.hpp>
+#include <opencv2/calib3d/calib3d.hpp>
+
+#include <eyes/calibrationBundle.hpp>
+
+#include "test.hpp"
+
+#define TEST_BUNDLE "test_bundle.bin"
+#define TEST_CORRUPT_BUNDLE "test_bundle_corrupt.bin"
+#define TEST_XML "test_bundle.xml"
+
+static const cv::Size image_size(320, 240);
+
+static bool sameMat(const cv::Mat &a, const cv::Mat &b)
+{
+    if (a.size() != b.size() || a.type() != b.type()) {
+        return false;
+    }
+
+    for (int y = 0; y < a.rows; y++) {
+        if (memcmp(a.ptr(y), b.ptr(y), a.cols * a.elemSize()) != 0) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static void cameraIntrinsics(struct camera_calibration *cam, double f)
+{
+    cam->intrinsics = (cv::Mat_<double>(3, 3) <<
+        f, 0, image_size.width / 2.0,
+        0, f, image_size.height / 2.0,
+        0, 0, 1
+    );
+    cam->distortion = (cv::Mat_<double>(5, 1) << -0.2, 0.05, 0, 0, 0);
+}
+
+static void monoBundle(struct calibration_bundle *bundle)
+{
+    initCalibrationBundle(bundle);
+    bundle->flags = BUNDLE_HAS_INTRINSICS;
+    bundle->num_cameras = 1;
+    bundle->image_size = image_size;
+    cameraIntrinsics(&bundle->camera[0], 300);
+    computeRemapTables(bundle);
+}
+
+static void stereoBundle(struct calibration_bundle *bundle)
+{
+    cv::Mat rotation_vector = (cv::Mat_<double>(3, 1) << 0, 0.02, 0);
+
+    initCalibrationBundle(bundle);
+    bundle->flags = BUNDLE_HAS_INTRINSICS | BUNDLE_HAS_STEREO;
+    bundle->num_cameras = 2;
+    bundle->image_size = image_size;
+    cameraIntrinsics(&bundle->camera[0], 300);
+    cameraIntrinsics(&bundle->camera[1], 310);
+    cv::Rodrigues(rotation_vector, bundle->rotation);
+    bundle->translation = (cv::Mat_<double>(3, 1) << -0.1, 0, 0);
+    computeRemapTables(bundle);
+}
+
+static bool sameBundle(
+    const struct calibration_bundle *a,
+    const struct calibration_bundle *b)
+{
+    if (a->flags != b->flags
+            || a->num_cameras != b->num_cameras
+            || a->image_size != b->image_size) {
+        return false;
+    }
+
+    for (int i = 0; i < a->num_cameras; i++) {
+        const struct camera_calibration *cam_a = &a->camera[i];
+        const struct camera_calibration *cam_b = &b->camera[i];
+
+        if (!sameMat(cam_a->intrinsics, cam_b->intrinsics)
+                || !sameMat(cam_a->distortion, cam_b->distortion)
+                || !sameMat(cam_a->rectification, cam_b->rectification)
+                || !sameMat(cam_a->projection, cam_b->projection)
+                || !sameMat(cam_a->map_1, cam_b->map_1)
+                || !sameMat(cam_a->map_2, cam_b->map_2)) {
+            return false;
+        }
+    }
+
+    return sameMat(a->rotation, b->rotation)
+        && sameMat(a->translation, b->translation)
+        && sameMat(a->disparity_to_depth, b->disparity_to_depth);
+}
+
+static int rewriteBundle(
+    const std::string &src,
+    const std::string &dst,
+    void (*corrupt)(std::vector<char> &data))
+{
+    std::vector<char> data;
+    FILE *fp;
+    long size;
+
+    fp = fopen(src.c_str(), "rb");
+    if (fp == NULL) {
+        return -1;
+    }
+    fseek(fp, 0, SEEK_END);
+    size = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+    data.resize(size);
+    if (fread(&data[0], 1, size, fp) != (size_t) size) {
+        fclose(fp);
+        return -1;
+    }
+    fclose(fp);
+
+    corrupt(data);
+
+    fp = fopen(dst.c_str(), "wb");
+    if (fp == NULL) {
+        return -1;
+    }
+    fwrite(&data[0], 1, data.size(), fp);
+    fclose(fp);
+
+    return 0;
+}
+
+static struct bundle_section *firstSection(std::vector<char> &data)
+{
+    return (struct bundle_section *) (&data[0] + sizeof(struct bundle_header));
+}
+
+static void negativeRows(std::vector<char> &data)
+{
+    firstSection(data)->rows = -1;
+}
+
+static void wrappingOffset(std::vector<char> &data)
+{
+    firstSection(data)->offset = UINT64_MAX - BUNDLE_ALIGNMENT + 1;
+}
+
+static void hugeMatrix(std::vector<char> &data)
+{
+    firstSection(data)->rows = 0x7fffffff;
+    firstSection(data)->cols = 0x7fffffff;
+}
+
+static void truncateData(std::vector<char> &data)
+{
+    data.resize(data.size() / 2);
+}
+
+
+// TESTS
+int testSaveLoadMono()
+{
+    struct calibration_bundle saved;
+    struct calibration_bundle loaded;
+
+    monoBundle(&saved);
+    TEST_CHECK(saved.flags & BUNDLE_HAS_MAPS);
+    TEST_CHECK(saveCalibrationBundle(TEST_BUNDLE, &saved) == 0);
+    TEST_CHECK(loadCalibrationBundle(TEST_BUNDLE, &loaded) == 0);
+    TEST_CHECK(loaded.mapping != NULL);
+    TEST_CHECK(sameBundle(&saved, &loaded));
+
+    releaseCalibrationBundle(&loaded);
+    TEST_CHECK(loaded.mapping == NULL);
+    TEST_CHECK(loaded.camera[0].map_1.empty());
+
+    return 0;
+}
+
+int testSaveLoadStereo()
+{
+    struct calibration_bundle saved;
+    struct calibration_bundle loaded;
+
+    stereoBundle(&saved);
+    TEST_CHECK(saved.flags & BUNDLE_HAS_MAPS);
+    TEST_CHECK(!saved.camera[1].rectification.empty());
+    TEST_CHECK(!saved.disparity_to_depth.empty());
+
+    TEST_CHECK(saveCalibrationBundle(TEST_BUNDLE, &saved) == 0);
+    TEST_CHECK(loadCalibrationBundle(TEST_BUNDLE, &loaded) == 0);
+    TEST_CHECK(loaded.num_cameras == 2);
+    TEST_CHECK(loaded.flags & BUNDLE_HAS_STEREO);
+    TEST_CHECK(sameBundle(&saved, &loaded));
+
+    // matrices point into the mapping, at aligned offsets
+    for (int i = 0; i < loaded.num_cameras; i++) {
+        const uchar *data = loaded.camera[i].map_1.data;
+
+        TEST_CHECK(data >= (uchar *) loaded.mapping);
+        TEST_CHECK(data < (uchar *) loaded.mapping + loaded.mapping_size);
+        TEST_CHECK((data - (uchar *) loaded.mapping) % BUNDLE_ALIGNMENT == 0);
+    }
+    releaseCalibrationBundle(&loaded);
+
+    return 0;
+}
+
+int testLoadCorrupt()
+{
+    struct calibration_bundle saved;
+    struct calibration_bundle loaded;
+    void (*corruptions[])(std::vector<char> &) = {
+        negativeRows,
+        wrappingOffset,
+        hugeMatrix,
+        truncateData
+    };
+
+    monoBundle(&saved);
+    TEST_CHECK(saveCalibrationBundle(TEST_BUNDLE, &saved) == 0);
+
+    for (size_t i = 0; i < sizeof(corruptions) / sizeof(corruptions[0]); i++) {
+        TEST_CHECK(rewriteBundle(TEST_BUNDLE, TEST_CORRUPT_BUNDLE, corruptions[i]) == 0);
+        TEST_CHECK(loadCalibrationBundle(TEST_CORRUPT_BUNDLE, &loaded) == -1);
+        TEST_CHECK(loaded.mapping == NULL);
+    }
+    TEST_CHECK(loadCalibrationBundle("does_not_exist.bin", &loaded) == -1);
+
+    return 0;
+}
+
+int testImportExportXML()
+{
+    struct calibration_bundle exported;
+    struct calibration_bundle imported;
+
+    stereoBundle(&exported);
+    TEST_CHECK(exportCalibrationXML(TEST_XML, &exported) == 0);
+    TEST_CHECK(importCalibrationXML(TEST_XML, &imported) == 0);
+
+    // remap tables are rebuilt on import, from the same parameters
+    TEST_CHECK(imported.flags == exported.flags);
+    TEST_CHECK(imported.num_cameras == 2);
+    TEST_CHECK(imported.image_size == image_size);
+    TEST_CHECK(cv::norm(imported.rotation, exported.rotation) < 1e-9);
+    TEST_CHECK(cv::norm(imported.translation, exported.translation) < 1e-9);
+    for (int i = 0; i < 2; i++) {
+        TEST_CHECK(cv::norm(
+            imported.camera[i].intrinsics,
+            exported.camera[i].intrinsics
+        ) < 1e-9);
+        TEST_CHECK(imported.camera[i].map_1.size() == image_size);
+    }
+
+    return 0;
+}
+
+int testLoadCalibration()
+{
+    struct calibration_bundle saved;
+    struct calibration_bundle loaded;
+
+    // stereo tools take either form, picked by the file name
+    stereoBundle(&saved);
+    TEST_CHECK(saveCalibrationBundle(TEST_BUNDLE, &saved) == 0);
+    TEST_CHECK(exportCalibrationXML(TEST_XML, &saved) == 0);
+
+    TEST_CHECK(loadCalibration(TEST_BUNDLE, &loaded) == 0);
+    TEST_CHECK(loaded.mapping != NULL);
+    TEST_CHECK(loaded.flags & BUNDLE_HAS_STEREO);
+    releaseCalibrationBundle(&loaded);
+
+    TEST_CHECK(loadCalibration(TEST_XML, &loaded) == 0);
+    TEST_CHECK(loaded.mapping == NULL);
+    TEST_CHECK(loaded.flags & BUNDLE_HAS_STEREO);
+    TEST_CHECK(loaded.flags & BUNDLE_HAS_MAPS);
+    TEST_CHECK(!loaded.disparity_to_depth.empty());
+
+    return 0;
+}
+
+int testRectifyFrame()
+{
+    struct calibration_bundle bundle;
+    cv::Mat frame(image_size, CV_8UC1, cv::Scalar(128));
+    cv::Mat small(image_size.height / 2, image_size.width / 2, CV_8UC1);
+    cv::Mat rectified;
+
+    stereoBundle(&bundle);
+    TEST_CHECK(rectifyFrame(&bundle, 0, frame, rectified) == 0);
+    TEST_CHECK(rectified.size() == image_size);
+    TEST_CHECK(rectifyFrame(&bundle, 1, frame, rectified) == 0);
+
+    // wrong size, unknown camera and missing tables never pass the input
+    // through as if it had been rectified
+    rectified.release();
+    TEST_CHECK(rectifyFrame(&bundle, 0, small, rectified) == -1);
+    TEST_CHECK(rectified.empty());
+    TEST_CHECK(rectifyFrame(&bundle, 2, frame, rectified) == -1);
+    TEST_CHECK(rectifyFrame(&bundle, -1, frame, rectified) == -1);
+    TEST_CHECK(rectified.empty());
+
+    bundle.camera[1].map_1.release();
+    TEST_CHECK(rectifyFrame(&bundle, 1, frame, rectified) == -1);
+    TEST_CHECK(rectified.empty());
+
+    return 0;
+}
+
+int main()
+{
+    int failures = 0;
+
+    TEST_RUN(testSaveLoadMono);
+    TEST_RUN(testSaveLoadStereo);
+    TEST_RUN(testLoadCorrupt);
+    TEST_RUN(testImportExportXML);
+    TEST_RUN(testLoadCalibration);
+    TEST_RUN(testRectifyFrame);
+
+    remove(TEST_BUNDLE);
+    remove(TEST_CORRUPT_BUNDLE);
+    remove(TEST_XML);
+
+    return failures == 0 ? 0 : 1;
+}
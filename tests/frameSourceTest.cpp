@@ -0,0 +1,86 @@
+#include <stdio.h>
+#include <string>
+
+#include <opencv2/core/core.hpp>
+#include <opencv2/highgui/highgui.hpp>
+
+#include <eyes/frameSource.hpp>
+
+#include "test.hpp"
+
+#define TEST_IMAGES 3
+
+static std::string imageName(int i)
+{
+    char name[64];
+    snprintf(name, sizeof(name), "test_sequence_%03d.png", i);
+    return name;
+}
+
+
+// TESTS
+int testImageSequence()
+{
+    ImageSequenceSource source("test_sequence_%03d.png");
+    Frame frame;
+
+    for (int i = 0; i < TEST_IMAGES; i++) {
+        cv::imwrite(imageName(i), cv::Mat(24, 32, CV_8UC3, cv::Scalar::all(i * 50)));
+    }
+
+    TEST_CHECK(source.isOpened());
+    TEST_CHECK(source.size() == cv::Size(32, 24));
+    for (int i = 0; i < TEST_IMAGES; i++) {
+        TEST_CHECK(source.read(frame));
+        TEST_CHECK(frame.image.at<cv::Vec3b>(0, 0)[0] == i * 50);
+    }
+    TEST_CHECK(!source.read(frame));
+
+    return 0;
+}
+
+int testImageSequencePattern()
+{
+    const char *invalid[] = {
+        "test_sequence.png",
+        "test_sequence_%s.png",
+        "test_sequence_%n.png",
+        "test_sequence_%x.png",
+        "test_sequence_%-3d.png",
+        "test_sequence_%03d_%d.png",
+        "test_sequence_%%%03d.png",
+        "test_sequence_%03d%"
+    };
+    Frame frame;
+
+    // the pattern is only ever formatted once it has been validated
+    for (size_t i = 0; i < sizeof(invalid) / sizeof(invalid[0]); i++) {
+        ImageSequenceSource source(invalid[i]);
+
+        TEST_CHECK(!source.isOpened());
+        TEST_CHECK(!source.read(frame));
+    }
+    TEST_CHECK(openFrameSource("images:test_sequence_%s.png", cv::Size()).empty());
+    TEST_CHECK(!openFrameSource("images:test_sequence_%03d.png", cv::Size()).empty());
+
+    // malformed raw specs are refused before anything is opened
+    TEST_CHECK(openFrameSource("raw:test.yuyv", cv::Size()).empty());
+    TEST_CHECK(openFrameSource("raw:test.yuyv:32by24:yuyv", cv::Size()).empty());
+    TEST_CHECK(openFrameSource("raw:test.yuyv:32x24:rgb565", cv::Size()).empty());
+
+    return 0;
+}
+
+int main()
+{
+    int failures = 0;
+
+    TEST_RUN(testImageSequence);
+    TEST_RUN(testImageSequencePattern);
+
+    for (int i = 0; i < TEST_IMAGES; i++) {
+        remove(imageName(i).c_str());
+    }
+
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,97 @@
+#include <math.h>
+
+#include <opencv2/core/core.hpp>
+
+#include <eyes/histogramTracker.hpp>
+
+#include "test.hpp"
+
+static const cv::Size frame_size(640, 480);
+static const int object_size = 60;
+
+// a saturated red square on a grey background, grey has no hue
+static cv::Mat sceneWith(cv::Point corner)
+{
+    cv::Mat frame(frame_size, CV_8UC3, cv::Scalar::all(128));
+
+    frame(cv::Rect(corner, cv::Size(object_size, object_size))).setTo(cv::Scalar(0, 0, 200));
+    return frame;
+}
+
+static bool near(cv::Point2f a, cv::Point2f b, float tolerance)
+{
+    return fabs(a.x - b.x) <= tolerance && fabs(a.y - b.y) <= tolerance;
+}
+
+
+// TESTS
+int testFollow()
+{
+    HistogramTracker tracker;
+    cv::Point corner(100, 100);
+
+    tracker.learn(sceneWith(corner), cv::Rect(corner, cv::Size(object_size, object_size)));
+    TEST_CHECK(tracker.isLearned());
+
+    // small steps stay inside the search area
+    for (int i = 0; i < 10; i++) {
+        corner += cv::Point(8, 5);
+        TEST_CHECK(tracker.track(sceneWith(corner)));
+        TEST_CHECK(near(tracker.box().center, corner + cv::Point(30, 30), 4));
+    }
+    TEST_CHECK(tracker.searchArea().area() < frame_size.area());
+
+    return 0;
+}
+
+int testReacquire()
+{
+    HistogramTracker tracker;
+    cv::Point corner(50, 50);
+    cv::Point jumped(500, 380);
+
+    tracker.learn(sceneWith(corner), cv::Rect(corner, cv::Size(object_size, object_size)));
+
+    // the object jumps out of the search area and is lost
+    TEST_CHECK(!tracker.track(sceneWith(jumped)));
+    TEST_CHECK(tracker.isLost());
+
+    // and is found again on the downscaled frame, with only a search area
+    // around it back projected at full resolution
+    TEST_CHECK(tracker.track(sceneWith(jumped)));
+    TEST_CHECK(!tracker.isLost());
+    TEST_CHECK(near(tracker.box().center, jumped + cv::Point(30, 30), 4));
+    TEST_CHECK(tracker.searchArea().area() < frame_size.area());
+    TEST_CHECK(tracker.backProjection().size() == tracker.searchArea().size());
+
+    return 0;
+}
+
+int testStaysLost()
+{
+    HistogramTracker tracker;
+    cv::Point corner(50, 50);
+    cv::Mat empty(frame_size, CV_8UC3, cv::Scalar::all(128));
+
+    tracker.learn(sceneWith(corner), cv::Rect(corner, cv::Size(object_size, object_size)));
+    TEST_CHECK(!tracker.track(empty));
+    TEST_CHECK(!tracker.track(empty));
+    TEST_CHECK(tracker.isLost());
+
+    // the whole frame is searched, downscaled
+    TEST_CHECK(tracker.searchArea() == cv::Rect(cv::Point(), frame_size));
+    TEST_CHECK(tracker.backProjection().cols == frame_size.width / CAMSHIFT_REACQUIRE_SCALE);
+
+    return 0;
+}
+
+int main()
+{
+    int failures = 0;
+
+    TEST_RUN(testFollow);
+    TEST_RUN(testReacquire);
+    TEST_RUN(testStaysLost);
+
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,144 @@
+#include <vector>
+
+#include <opencv2/core/core.hpp>
+
+#include <eyes/motionGate.hpp>
+
+#include "test.hpp"
+
+static const cv::Size frame_size(320, 240);
+
+static cv::Mat greyFrame(int level)
+{
+    return cv::Mat(frame_size, CV_8UC3, cv::Scalar::all(level));
+}
+
+
+// TESTS
+int testStaticFrames()
+{
+    MotionGate gate;
+    cv::Mat frame = greyFrame(100);
+
+    // everything is stale on the first frame, nothing after it
+    TEST_CHECK(gate.update(frame) == gate.numTiles());
+    TEST_CHECK(gate.update(frame) == 0);
+    TEST_CHECK(gate.update(frame.clone()) == 0);
+    TEST_CHECK(gate.changedRegions(0).empty());
+
+    return 0;
+}
+
+int testChangedTile()
+{
+    MotionGate gate;
+    cv::Mat frame = greyFrame(100);
+    std::vector<cv::Rect> regions;
+    cv::Rect tile;
+
+    gate.update(frame);
+    tile = gate.tileRect(3, 2);
+    frame(tile).setTo(cv::Scalar::all(200));
+
+    TEST_CHECK(gate.update(frame) == 1);
+    TEST_CHECK(gate.tileChanged(3, 2));
+    TEST_CHECK(!gate.tileChanged(4, 2));
+    TEST_CHECK(gate.rowChanged(2));
+    TEST_CHECK(!gate.rowChanged(3));
+
+    // the region covers the tile and stays inside the frame
+    regions = gate.changedRegions(0);
+    TEST_CHECK(regions.size() == 1);
+    TEST_CHECK((regions[0] & tile) == tile);
+    TEST_CHECK((regions[0] & cv::Rect(cv::Point(), frame_size)) == regions[0]);
+
+    // the reference follows the processed tile
+    TEST_CHECK(gate.update(frame) == 0);
+
+    return 0;
+}
+
+int testSlowDrift()
+{
+    MotionGate gate;
+
+    gate.update(greyFrame(100));
+
+    // below the threshold one step at a time, but not in total
+    TEST_CHECK(gate.update(greyFrame(100 + MOTION_THRESHOLD / 2 + 1)) == 0);
+    TEST_CHECK(gate.update(greyFrame(100 + MOTION_THRESHOLD + 2)) == gate.numTiles());
+
+    return 0;
+}
+
+int testInvalidate()
+{
+    MotionGate gate;
+    cv::Mat frame = greyFrame(100);
+    cv::Mat larger(frame_size.height * 2, frame_size.width * 2, CV_8UC3);
+
+    gate.update(frame);
+    gate.invalidate();
+    TEST_CHECK(gate.update(frame) == gate.numTiles());
+    TEST_CHECK(gate.update(frame) == 0);
+
+    // a new frame size is a new scene
+    larger.setTo(cv::Scalar::all(100));
+    TEST_CHECK(gate.update(larger) == gate.numTiles());
+    TEST_CHECK(gate.tileRect(0, 0).width == frame_size.width * 2 / MOTION_TILE_COLS);
+
+    return 0;
+}
+
+int testMergedRegions()
+{
+    MotionGate gate;
+    cv::Mat frame = greyFrame(100);
+    std::vector<cv::Rect> regions;
+
+    gate.update(frame);
+
+    // neighbouring tiles on two rows touch once grown and become one
+    // region, a tile on the far side of the frame stays on its own
+    frame(gate.tileRect(3, 2)).setTo(cv::Scalar::all(200));
+    frame(gate.tileRect(4, 3)).setTo(cv::Scalar::all(200));
+    frame(gate.tileRect(12, 9)).setTo(cv::Scalar::all(200));
+    TEST_CHECK(gate.update(frame) == 3);
+
+    regions = gate.changedRegions(2);
+    TEST_CHECK(regions.size() == 2);
+    for (size_t i = 0; i < regions.size(); i++) {
+        for (size_t j = i + 1; j < regions.size(); j++) {
+            TEST_CHECK((regions[i] & regions[j]).area() == 0);
+        }
+    }
+
+    return 0;
+}
+
+int testGreyInput()
+{
+    MotionGate gate;
+    cv::Mat frame(frame_size, CV_8UC1, cv::Scalar(100));
+
+    TEST_CHECK(gate.update(frame) == gate.numTiles());
+    frame(gate.tileRect(0, 0)).setTo(cv::Scalar(200));
+    TEST_CHECK(gate.update(frame) == 1);
+    TEST_CHECK(gate.tileChanged(0, 0));
+
+    return 0;
+}
+
+int main()
+{
+    int failures = 0;
+
+    TEST_RUN(testStaticFrames);
+    TEST_RUN(testChangedTile);
+    TEST_RUN(testSlowDrift);
+    TEST_RUN(testInvalidate);
+    TEST_RUN(testMergedRegions);
+    TEST_RUN(testGreyInput);
+
+    return failures == 0 ? 0 : 1;
+}
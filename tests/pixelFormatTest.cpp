@@ -0,0 +1,176 @@
+#include <stdlib.h>
+#include <algorithm>
+
+#include <opencv2/core/core.hpp>
+#include <opencv2/imgproc/imgproc.hpp>
+
+#include <eyes/frameSource.hpp>
+#include <eyes/pixelFormat.hpp>
+
+#include "test.hpp"
+
+#define TEST_BLOCK 8
+
+// moderate colours, clear of the limited range clipping
+static const cv::Vec3b colours[] = {
+    cv::Vec3b(40, 80, 160),
+    cv::Vec3b(200, 60, 30),
+    cv::Vec3b(90, 170, 90),
+    cv::Vec3b(128, 128, 128),
+    cv::Vec3b(30, 200, 220),
+    cv::Vec3b(180, 40, 180)
+};
+static const int num_colours = sizeof(colours) / sizeof(colours[0]);
+
+// flat blocks larger than a chroma sample, so subsampling loses nothing
+static cv::Mat testImage()
+{
+    cv::Mat bgr(48, 64, CV_8UC3);
+
+    for (int row = 0; row < bgr.rows; row++) {
+        for (int x = 0; x < bgr.cols; x++) {
+            int block = row / TEST_BLOCK * (bgr.cols / TEST_BLOCK) + x / TEST_BLOCK;
+
+            bgr.at<cv::Vec3b>(row, x) = colours[block % num_colours];
+        }
+    }
+
+    return bgr;
+}
+
+static Frame packedFrame(const cv::Mat &bgr, enum frame_format format)
+{
+    Frame frame;
+
+    convertFromBGR(bgr, format, frame.image);
+    frame.format = format;
+    return frame;
+}
+
+static int hueDistance(int a, int b)
+{
+    int d = abs(a - b);
+    return std::min(d, 180 - d);
+}
+
+
+// TESTS
+int testGray()
+{
+    cv::Mat bgr = testImage();
+    cv::Mat gray;
+    cv::Mat expected;
+    Frame packed[] = {
+        packedFrame(bgr, FORMAT_GRAY),
+        packedFrame(bgr, FORMAT_YUYV),
+        packedFrame(bgr, FORMAT_NV12)
+    };
+
+    // grey of every format is the same Y plane
+    convertFromBGR(bgr, FORMAT_GRAY, expected);
+    for (int i = 0; i < 3; i++) {
+        frameToGray(packed[i], gray);
+        TEST_CHECK(gray.size() == bgr.size());
+        TEST_CHECK(gray.type() == CV_8UC1);
+        TEST_CHECK(cv::norm(gray, expected, cv::NORM_INF) == 0);
+    }
+
+    // and a view of the frame where the plane is contiguous
+    frameToGray(packed[2], gray);
+    TEST_CHECK(gray.data == packed[2].image.data);
+    frameToGray(packed[0], gray);
+    TEST_CHECK(gray.data == packed[0].image.data);
+
+    return 0;
+}
+
+int testBGRRoundTrip()
+{
+    cv::Mat bgr = testImage();
+    cv::Mat decoded;
+    enum frame_format formats[] = {FORMAT_BGR, FORMAT_YUYV, FORMAT_NV12};
+
+    for (int i = 0; i < 3; i++) {
+        Frame frame = packedFrame(bgr, formats[i]);
+
+        frameToBGR(frame, decoded);
+        TEST_CHECK(decoded.size() == bgr.size());
+        TEST_CHECK(decoded.type() == CV_8UC3);
+        TEST_CHECK(cv::norm(decoded, bgr, cv::NORM_INF) <= 3);
+    }
+
+    return 0;
+}
+
+int testHSVMatchesBGR()
+{
+    cv::Mat bgr = testImage();
+    cv::Mat decoded;
+    cv::Mat direct;
+    cv::Mat expected;
+    enum frame_format formats[] = {FORMAT_BGR, FORMAT_YUYV, FORMAT_NV12};
+
+    // straight from YUV gives what cvtColor gives through BGR
+    for (int i = 0; i < 3; i++) {
+        Frame frame = packedFrame(bgr, formats[i]);
+
+        frameToBGR(frame, decoded);
+        cv::cvtColor(decoded, expected, cv::COLOR_BGR2HSV);
+        frameToHSV(frame, direct);
+        TEST_CHECK(direct.size() == bgr.size());
+        TEST_CHECK(direct.type() == CV_8UC3);
+
+        for (int row = 0; row < direct.rows; row++) {
+            for (int x = 0; x < direct.cols; x++) {
+                cv::Vec3b a = direct.at<cv::Vec3b>(row, x);
+                cv::Vec3b b = expected.at<cv::Vec3b>(row, x);
+
+                // hue is meaningless without saturation
+                if (b[1] > 32) {
+                    TEST_CHECK(hueDistance(a[0], b[0]) <= 1);
+                }
+                TEST_CHECK(abs(a[1] - b[1]) <= 1);
+                TEST_CHECK(abs(a[2] - b[2]) <= 1);
+            }
+        }
+    }
+
+    return 0;
+}
+
+int testGrayHSV()
+{
+    Frame frame;
+    cv::Mat hsv;
+
+    frame.image = cv::Mat(24, 32, CV_8UC1, cv::Scalar(77));
+    frame.format = FORMAT_GRAY;
+
+    // no hue and no saturation, value is the grey level
+    frameToHSV(frame, hsv);
+    TEST_CHECK(hsv.size() == frame.image.size());
+    TEST_CHECK(cv::norm(hsv, cv::Mat(24, 32, CV_8UC3, cv::Scalar(0, 0, 77)), cv::NORM_INF) == 0);
+
+    return 0;
+}
+
+int testUnknownCameraFormat()
+{
+    // an unknown format fails the open instead of falling back to BGR
+    TEST_CHECK(openFrameSource("camera:0:rgb565", cv::Size(320, 240)).empty());
+
+    return 0;
+}
+
+int main()
+{
+    int failures = 0;
+
+    TEST_RUN(testGray);
+    TEST_RUN(testBGRRoundTrip);
+    TEST_RUN(testHSVMatchesBGR);
+    TEST_RUN(testGrayHSV);
+    TEST_RUN(testUnknownCameraFormat);
+
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,179 @@
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <string>
+#include <vector>
+
+#include <opencv2/core/core.hpp>
+
+#include <eyes/frameSource.hpp>
+#include <eyes/recording.hpp>
+
+#include "test.hpp"
+
+#define TEST_RECORDING "test_recording.eyes"
+#define TEST_RECORDS 40     // more than one chunk per stream
+
+static Frame testFrame(int i, enum frame_format format)
+{
+    Frame frame;
+
+    if (format == FORMAT_YUYV) {
+        frame.image = cv::Mat(24, 32, CV_8UC2, cv::Scalar::all(i));
+    } else {
+        frame.image = cv::Mat(24, 32, CV_8UC3, cv::Scalar::all(i));
+    }
+    frame.format = format;
+    frame.timestamp = 1000 + i * 33333;
+    frame.sequence = i;
+
+    return frame;
+}
+
+static int recordFrames(const char *path, int records)
+{
+    FrameRecorder recorder(path, 2, records);
+
+    if (!recorder.isOpened()) {
+        return -1;
+    }
+    for (int i = 0; i < records; i++) {
+        if (!recorder.record(testFrame(i, FORMAT_BGR), testFrame(i, FORMAT_YUYV))) {
+            return -1;
+        }
+    }
+    if (recorder.close() != 0) {
+        return -1;
+    }
+
+    return recorder.dropped() == 0 ? 0 : -1;
+}
+
+
+// TESTS
+int testRoundTrip()
+{
+    std::shared_ptr<RecordingFile> file;
+    Frame frame;
+
+    TEST_CHECK(recordFrames(TEST_RECORDING, TEST_RECORDS) == 0);
+
+    file = RecordingFile::open(TEST_RECORDING);
+    TEST_CHECK(file);
+    TEST_CHECK(file->numStreams() == 2);
+    TEST_CHECK(file->stream(0).size() == TEST_RECORDS);
+    TEST_CHECK(file->stream(1).size() == TEST_RECORDS);
+
+    // frames come back in order, in the format they were recorded in
+    for (int s = 0; s < 2; s++) {
+        ReplaySource replay(TEST_RECORDING, s, false);
+
+        TEST_CHECK(replay.isOpened());
+        TEST_CHECK(replay.size() == cv::Size(32, 24));
+        for (int i = 0; i < TEST_RECORDS; i++) {
+            Frame expected = testFrame(i, s == 0 ? FORMAT_BGR : FORMAT_YUYV);
+
+            TEST_CHECK(replay.read(frame));
+            TEST_CHECK(frame.format == expected.format);
+            TEST_CHECK(frame.timestamp == expected.timestamp);
+            TEST_CHECK(frame.sequence == (uint64_t) i);
+            TEST_CHECK(frame.image.type() == expected.image.type());
+            TEST_CHECK(cv::norm(frame.image, expected.image, cv::NORM_INF) == 0);
+        }
+        TEST_CHECK(!replay.read(frame));
+    }
+
+    return 0;
+}
+
+int testCutShort()
+{
+    struct recording_header header;
+    struct recording_chunk trailer;
+    FILE *fp;
+
+    TEST_CHECK(recordFrames(TEST_RECORDING, TEST_RECORDS) == 0);
+
+    // a crash after the second chunk leaves the header pointing at it and
+    // the file ending somewhere in the frames that followed
+    fp = fopen(TEST_RECORDING, "r+b");
+    TEST_CHECK(fp != NULL);
+    TEST_CHECK(fread(&header, sizeof(header), 1, fp) == 1);
+    fseek(fp, header.last_chunk, SEEK_SET);
+    TEST_CHECK(fread(&trailer, sizeof(trailer), 1, fp) == 1);
+    TEST_CHECK(trailer.previous_chunk != 0);
+
+    header.num_frames -= trailer.num_entries;
+    header.last_chunk = trailer.previous_chunk;
+    fseek(fp, 0, SEEK_SET);
+    fwrite(&header, sizeof(header), 1, fp);
+    fclose(fp);
+    TEST_CHECK(truncate(TEST_RECORDING, header.last_chunk + 4096 + 100) == 0);
+
+    std::shared_ptr<RecordingFile> file = RecordingFile::open(TEST_RECORDING);
+    TEST_CHECK(file);
+    TEST_CHECK(file->stream(0).size() == RECORDING_CHUNK_FRAMES);
+    TEST_CHECK(file->stream(1).size() == RECORDING_CHUNK_FRAMES);
+
+    return 0;
+}
+
+int testInvalid()
+{
+    FrameRecorder no_streams(TEST_RECORDING, 0);
+    FrameRecorder too_many(TEST_RECORDING, RECORDING_MAX_STREAMS + 1);
+    std::vector<Frame> frames(1, testFrame(0, FORMAT_BGR));
+    FILE *fp;
+
+    TEST_CHECK(!no_streams.isOpened());
+    TEST_CHECK(!too_many.isOpened());
+
+    // every record carries one frame per stream
+    {
+        FrameRecorder recorder(TEST_RECORDING, 2);
+
+        TEST_CHECK(recorder.isOpened());
+        TEST_CHECK(!recorder.record(frames));
+        TEST_CHECK(!recorder.record(frames[0]));
+    }
+    TEST_CHECK(!ReplaySource(TEST_RECORDING, 2, false).isOpened());
+    TEST_CHECK(!ReplaySource(TEST_RECORDING, -1, false).isOpened());
+
+    fp = fopen(TEST_RECORDING, "wb");
+    TEST_CHECK(fp != NULL);
+    fprintf(fp, "not a recording, but longer than a recording header");
+    fclose(fp);
+    TEST_CHECK(!RecordingFile::open(TEST_RECORDING));
+
+    return 0;
+}
+
+int testWriteFailure()
+{
+    FrameRecorder recorder("/dev/full", 1);
+
+    // every write fails on a full disk, the recording stops and says so
+    TEST_CHECK(recorder.isOpened());
+    for (int i = 0; i < TEST_RECORDS; i++) {
+        recorder.record(testFrame(i, FORMAT_BGR));
+    }
+    TEST_CHECK(recorder.close() == -1);
+    TEST_CHECK(recorder.hasFailed());
+    TEST_CHECK(!recorder.record(testFrame(0, FORMAT_BGR)));
+
+    return 0;
+}
+
+int main()
+{
+    int failures = 0;
+
+    TEST_RUN(testRoundTrip);
+    TEST_RUN(testCutShort);
+    TEST_RUN(testInvalid);
+    TEST_RUN(testWriteFailure);
+
+    remove(TEST_RECORDING);
+
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,170 @@
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+#include <opencv2/core/core.hpp>
+#include <opencv2/highgui/highgui.hpp>
+
+#include <eyes/frameSource.hpp>
+#include <eyes/recording.hpp>
+#include <eyes/sourceConfig.hpp>
+
+#include "test.hpp"
+
+#define TEST_CONFIG "test_sources.yml"
+#define TEST_RECORDING "test_sources.eyes"
+#define TEST_RAW "test_sources.yuyv"
+#define TEST_FRAMES 3
+
+// startup target for opening every source of a configuration
+#define OPEN_SOURCES_MAX_SECONDS 1.0
+
+static std::string imageName(int i)
+{
+    char name[64];
+    snprintf(name, sizeof(name), "test_sources_%03d.png", i);
+    return name;
+}
+
+// file backed inputs for every kind of spec that stands in for a camera
+static int writeInputs()
+{
+    FrameRecorder recorder(TEST_RECORDING, 2, TEST_FRAMES);
+    cv::Mat yuyv(24, 32, CV_8UC2, cv::Scalar::all(90));
+    FILE *fp;
+
+    if (!recorder.isOpened()) {
+        return -1;
+    }
+    for (int i = 0; i < TEST_FRAMES; i++) {
+        Frame frame;
+
+        frame.image = cv::Mat(24, 32, CV_8UC3, cv::Scalar::all(i));
+        frame.sequence = i;
+        if (!recorder.record(frame, frame)) {
+            return -1;
+        }
+    }
+    recorder.close();
+
+    fp = fopen(TEST_RAW, "wb");
+    if (fp == NULL) {
+        return -1;
+    }
+    for (int i = 0; i < TEST_FRAMES; i++) {
+        fwrite(yuyv.data, 1, yuyv.total() * yuyv.elemSize(), fp);
+    }
+    fclose(fp);
+
+    for (int i = 0; i < TEST_FRAMES; i++) {
+        cv::imwrite(imageName(i), cv::Mat(24, 32, CV_8UC3, cv::Scalar::all(i)));
+    }
+
+    return 0;
+}
+
+static struct source_config testConfig()
+{
+    struct source_config config;
+
+    config.specs.push_back("replay:" TEST_RECORDING ":0");
+    config.specs.push_back("replay:" TEST_RECORDING ":1:fast");
+    config.specs.push_back("raw:" TEST_RAW ":32x24:yuyv");
+    config.specs.push_back("images:test_sources_%03d.png");
+    config.specs.push_back("synthetic:64x48:4");
+    config.size = cv::Size(32, 24);
+
+    return config;
+}
+
+
+// TESTS
+int testSaveLoad()
+{
+    struct source_config saved = testConfig();
+    struct source_config loaded;
+
+    saved.devices.push_back("/dev/video0 HD Webcam");
+    saved.devices.push_back("/dev/video2 HD Webcam");
+    TEST_CHECK(saveSourceConfig(TEST_CONFIG, &saved) == 0);
+    TEST_CHECK(loadSourceConfig(TEST_CONFIG, &loaded) == 0);
+    TEST_CHECK(loaded.specs == saved.specs);
+    TEST_CHECK(loaded.devices == saved.devices);
+    TEST_CHECK(loaded.size == saved.size);
+
+    // a configuration without sources is no configuration
+    saved.specs.clear();
+    TEST_CHECK(saveSourceConfig(TEST_CONFIG, &saved) == 0);
+    TEST_CHECK(loadSourceConfig(TEST_CONFIG, &loaded) == -1);
+    TEST_CHECK(loadSourceConfig("does_not_exist.yml", &loaded) == -1);
+
+    return 0;
+}
+
+int testOpenSourcesTime()
+{
+    struct source_config saved = testConfig();
+    struct source_config config;
+    std::vector<cv::Ptr<FrameSource> > sources;
+    int64 start;
+    double seconds;
+    Frame frame;
+
+    // the same path as --config, from the file to open sources
+    TEST_CHECK(writeInputs() == 0);
+    TEST_CHECK(saveSourceConfig(TEST_CONFIG, &saved) == 0);
+    TEST_CHECK(loadSourceConfig(TEST_CONFIG, &config) == 0);
+
+    start = cv::getTickCount();
+    sources = openFrameSources(config.specs, config.size);
+    seconds = (cv::getTickCount() - start) / cv::getTickFrequency();
+
+    TEST_CHECK(sources.size() == config.specs.size());
+    for (size_t i = 0; i < sources.size(); i++) {
+        TEST_CHECK(!sources[i].empty());
+        TEST_CHECK(sources[i]->read(frame));
+    }
+    printf("open_sources: %zu sources in %.3f s\n", sources.size(), seconds);
+    TEST_CHECK(seconds < OPEN_SOURCES_MAX_SECONDS);
+
+    return 0;
+}
+
+int testOpenSourcesFailure()
+{
+    std::vector<std::string> specs;
+    std::vector<cv::Ptr<FrameSource> > sources;
+
+    specs.push_back("synthetic:64x48");
+    specs.push_back("replay:does_not_exist.eyes:0");
+    specs.push_back("camera:0:rgb565");
+    specs.push_back("synthetic:64x48:4");
+
+    // the sources that failed are left empty, the rest still open
+    sources = openFrameSources(specs, cv::Size(64, 48));
+    TEST_CHECK(sources.size() == specs.size());
+    TEST_CHECK(!sources[0].empty());
+    TEST_CHECK(sources[1].empty());
+    TEST_CHECK(sources[2].empty());
+    TEST_CHECK(!sources[3].empty());
+
+    return 0;
+}
+
+int main()
+{
+    int failures = 0;
+
+    TEST_RUN(testSaveLoad);
+    TEST_RUN(testOpenSourcesTime);
+    TEST_RUN(testOpenSourcesFailure);
+
+    remove(TEST_CONFIG);
+    remove(TEST_RECORDING);
+    remove(TEST_RAW);
+    for (int i = 0; i < TEST_FRAMES; i++) {
+        remove(imageName(i).c_str());
+    }
+
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,80 @@
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <eyes/stats.hpp>
+
+#include "test.hpp"
+
+#define TEST_STATS "test_stats.json"
+#define TEST_THREADS 8
+#define TEST_RECORDS 100
+
+static std::string readFile(const char *path)
+{
+    std::string content;
+    char buffer[4096];
+    size_t n;
+    FILE *fp = fopen(path, "r");
+
+    if (fp == NULL) {
+        return content;
+    }
+    while ((n = fread(buffer, 1, sizeof(buffer), fp)) > 0) {
+        content.append(buffer, n);
+    }
+    fclose(fp);
+
+    return content;
+}
+
+
+// TESTS
+int testExitedThreads()
+{
+    std::vector<std::thread> workers;
+    int stage = statsRegisterStage("test_stage");
+    std::string json;
+    char expected[64];
+
+    TEST_CHECK(stage >= 0);
+
+    // recordings of threads that already exited are still exported
+    for (int i = 0; i < TEST_THREADS; i++) {
+        workers.push_back(std::thread([stage]() {
+            for (int j = 0; j < TEST_RECORDS; j++) {
+                statsRecord(stage, 1000);
+            }
+        }));
+    }
+    for (size_t i = 0; i < workers.size(); i++) {
+        workers[i].join();
+    }
+    statsRecord(stage, 1000);
+
+    TEST_CHECK(statsDump(TEST_STATS) == 0);
+    json = readFile(TEST_STATS);
+    snprintf(
+        expected,
+        sizeof(expected),
+        "\"test_stage\": {\"count\": %d,",
+        TEST_THREADS * TEST_RECORDS + 1
+    );
+    TEST_CHECK(json.find(expected) != std::string::npos);
+    TEST_CHECK(json.find("\"max_us\": 1.000}") != std::string::npos);
+
+    return 0;
+}
+
+int main()
+{
+    int failures = 0;
+
+    TEST_RUN(testExitedThreads);
+
+    remove(TEST_STATS);
+
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,27 @@
+#ifndef EYES_TEST_HPP
+#define EYES_TEST_HPP
+
+#include <stdio.h>
+
+// Tests are functions returning 0 on success. A failed check reports the
+// expression and fails the test, TEST_RUN counts failed tests in the
+// failures variable of the caller.
+#define TEST_CHECK(A) \
+    do { \
+        if (!(A)) { \
+            fprintf(stderr, "[FAILED] %s:%d: %s\n", __FILE__, __LINE__, #A); \
+            return -1; \
+        } \
+    } while (0)
+
+#define TEST_RUN(TEST) \
+    do { \
+        if (TEST() != 0) { \
+            fprintf(stderr, "[FAILED] %s\n", #TEST); \
+            failures++; \
+        } else { \
+            printf("[PASSED] %s\n", #TEST); \
+        } \
+    } while (0)
+
+#endif